@@ -43,6 +43,7 @@
 #include "sysemu/cpu-timers.h"
 #include "sysemu/replay.h"
 #include "internal.h"
+#include "tb-tier.h"
 
 /* -icount align implementation. */
 
@@ -459,11 +460,16 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
     tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, cf_mask);
     if (tb == NULL) {
         mmap_lock();
-        tb = tb_gen_code(cpu, pc, cs_base, flags, cf_mask);
+        tb = tb_gen_code(cpu, pc, cs_base, flags,
+                         cf_mask | (tb_tier_threshold ? CF_COLD : 0));
         mmap_unlock();
         /* We add the TB in the virtual pc hash table for the fast lookup */
         qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
     }
+    if (unlikely(tb_cflags(tb) & CF_COLD)) {
+        tb_tier_exec(cpu, tb);
+        return tb;
+    }
 #ifndef CONFIG_USER_ONLY
     /* We don't take care of direct jumps when address mapping changes in
      * system emulation. So it's not safe to make a direct jump to a TB
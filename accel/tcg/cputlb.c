@@ -235,11 +235,12 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
-    desc->large_page_addr = -1;
-    desc->large_page_mask = -1;
+    desc->n_large_pages = 0;
+    desc->lindex = 0;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->ltable, -1, sizeof(desc->ltable));
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
@@ -324,6 +325,21 @@ static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
     }
 }
 
+void tlb_large_page_counts(size_t *pfill, size_t *pflush)
+{
+    CPUState *cpu;
+    size_t fill = 0, flush = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        fill += qatomic_read(&env_tlb(env)->c.large_fill_count);
+        flush += qatomic_read(&env_tlb(env)->c.large_flush_count);
+    }
+    *pfill = fill;
+    *pflush = flush;
+}
+
 void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
 {
     CPUState *cpu;
@@ -495,24 +511,72 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(env, mmu_idx, page, -1);
 }
 
+/*
+ * Flush all the entries of the large page @lp, and forget about it.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_page_locked(CPUArchState *env, int midx,
+                                        CPUTLBLargeEntry *lp)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    target_ulong addr = lp->vaddr;
+    target_ulong mask = lp->mask;
+    size_t n_pages = (-mask) >> TARGET_PAGE_BITS;
+    size_t n_entries = tlb_n_entries(f);
+    size_t i;
+
+    tlb_debug("flushing large page midx %d ("
+              TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+              midx, addr, mask);
+
+    if (n_pages > n_entries) {
+        /* Checking every entry of the tlb is cheaper.  */
+        for (i = 0; i < n_entries; i++) {
+            if (tlb_flush_entry_mask_locked(&f->table[i], addr, mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    } else {
+        for (i = 0; i < n_pages; i++) {
+            target_ulong page = addr + ((target_ulong)i << TARGET_PAGE_BITS);
+
+            if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+    }
+    tlb_flush_vtlb_page_mask_locked(env, midx, addr, mask);
+
+    memset(lp, -1, sizeof(*lp));
+    d->n_large_pages--;
+    qatomic_set(&env_tlb(env)->c.large_flush_count,
+                env_tlb(env)->c.large_flush_count + 1);
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    int i;
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
-            tlb_n_used_entries_dec(env, midx);
+    /*
+     * Large pages never overlap, and the entries of the one containing
+     * @page include that of @page itself.
+     */
+    for (i = 0; d->n_large_pages && i < CPU_LTLB_SIZE; i++) {
+        CPUTLBLargeEntry *lp = &d->ltable[i];
+
+        if ((page & lp->mask) == lp->vaddr) {
+            tlb_flush_large_page_locked(env, midx, lp);
+            return;
         }
-        tlb_flush_vtlb_page_locked(env, midx, page);
     }
+
+    if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
+        tlb_n_used_entries_dec(env, midx);
+    }
+    tlb_flush_vtlb_page_locked(env, midx, page);
 }
 
 /**
@@ -709,12 +773,42 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
-static void tlb_flush_page_bits_locked(CPUArchState *env, int midx,
-                                       target_ulong page, unsigned bits)
+/* Called with tlb_c.lock held */
+static bool tlb_flush_entry_range_locked(CPUTLBEntry *tlb_entry,
+                                         target_ulong addr, target_ulong len,
+                                         target_ulong mask)
+{
+    target_ulong cmp[3] = {
+        tlb_entry->addr_read,
+        tlb_addr_write(tlb_entry),
+        tlb_entry->addr_code,
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(cmp); i++) {
+        if (!(cmp[i] & TLB_INVALID_MASK) &&
+            (((cmp[i] & TARGET_PAGE_MASK) - addr) & mask) < len) {
+            memset(tlb_entry, -1, sizeof(*tlb_entry));
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Flush the pages in [@addr, @addr + @len), comparing only the low @bits
+ * of the addresses.  Called with tlb_c.lock held.
+ */
+static void tlb_flush_range_locked(CPUArchState *env, int midx,
+                                   target_ulong addr, target_ulong len,
+                                   unsigned bits)
 {
     CPUTLBDesc *d = &env_tlb(env)->d[midx];
     CPUTLBDescFast *f = &env_tlb(env)->f[midx];
     target_ulong mask = MAKE_64BIT_MASK(0, bits);
+    target_ulong n_pages = len >> TARGET_PAGE_BITS;
+    size_t n_entries = tlb_n_entries(f);
+    size_t i;
 
     /*
      * If @bits is smaller than the tlb size, there may be multiple entries
@@ -726,221 +820,226 @@ static void tlb_flush_page_bits_locked(CPUArchState *env, int midx,
      */
     if (mask < f->mask) {
         tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, page, mask);
+                  TARGET_FMT_lx "/" TARGET_FMT_lx "+" TARGET_FMT_lx ")\n",
+                  midx, addr, mask, len);
         tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
         return;
     }
 
-    /* Check if we need to flush due to large pages.  */
-    if ((page & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+    addr &= mask;
+
+    /* Flush the large pages that overlap the range under @mask.  */
+    for (i = 0; d->n_large_pages && i < CPU_LTLB_SIZE; i++) {
+        CPUTLBLargeEntry *lp = &d->ltable[i];
+
+        if (lp->vaddr != (target_ulong)-1 &&
+            (((lp->vaddr - addr) & mask) < len ||
+             ((addr - lp->vaddr) & mask) < (target_ulong)-lp->mask)) {
+            tlb_flush_large_page_locked(env, midx, lp);
+        }
+    }
+
+    if (n_pages > n_entries) {
+        /* Checking every entry of the tlb is cheaper.  */
+        for (i = 0; i < n_entries; i++) {
+            if (tlb_flush_entry_range_locked(&f->table[i], addr, len, mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+            if (tlb_flush_entry_range_locked(&d->vtable[i], addr, len, mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
         return;
     }
 
-    if (tlb_flush_entry_mask_locked(tlb_entry(env, midx, page), page, mask)) {
-        tlb_n_used_entries_dec(env, midx);
+    for (i = 0; i < n_pages; i++) {
+        target_ulong page = addr + ((target_ulong)i << TARGET_PAGE_BITS);
+
+        if (tlb_flush_entry_mask_locked(tlb_entry(env, midx, page),
+                                        page, mask)) {
+            tlb_n_used_entries_dec(env, midx);
+        }
+        tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
     }
-    tlb_flush_vtlb_page_mask_locked(env, midx, page, mask);
 }
 
 typedef struct {
     target_ulong addr;
+    target_ulong len;
     uint16_t idxmap;
     uint16_t bits;
-} TLBFlushPageBitsByMMUIdxData;
+} TLBFlushRangeData;
 
-static void
-tlb_flush_page_bits_by_mmuidx_async_0(CPUState *cpu,
-                                      TLBFlushPageBitsByMMUIdxData d)
+static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
+                                              TLBFlushRangeData d)
 {
     CPUArchState *env = cpu->env_ptr;
+    target_ulong i;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
 
-    tlb_debug("page addr:" TARGET_FMT_lx "/%u mmu_map:0x%x\n",
-              d.addr, d.bits, d.idxmap);
+    tlb_debug("range:" TARGET_FMT_lx "/%u+" TARGET_FMT_lx " mmu_map:0x%x\n",
+              d.addr, d.bits, d.len, d.idxmap);
 
     qemu_spin_lock(&env_tlb(env)->c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         if ((d.idxmap >> mmu_idx) & 1) {
-            tlb_flush_page_bits_locked(env, mmu_idx, d.addr, d.bits);
+            tlb_flush_range_locked(env, mmu_idx, d.addr, d.len, d.bits);
         }
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-    tb_flush_jmp_cache(cpu, d.addr);
-}
-
-static bool encode_pbm_to_runon(run_on_cpu_data *out,
-                                TLBFlushPageBitsByMMUIdxData d)
-{
-    /* We need 6 bits to hold to hold @bits up to 63. */
-    if (d.idxmap <= MAKE_64BIT_MASK(0, TARGET_PAGE_BITS - 6)) {
-        *out = RUN_ON_CPU_TARGET_PTR(d.addr | (d.idxmap << 6) | d.bits);
-        return true;
+    /*
+     * Each page clears TB_JMP_PAGE_SIZE entries of the jump cache; past
+     * that many pages, clearing all of it is cheaper.
+     */
+    if ((d.len >> TARGET_PAGE_BITS) >= TB_JMP_CACHE_SIZE / TB_JMP_PAGE_SIZE) {
+        cpu_tb_jmp_cache_clear(cpu);
+        return;
+    }
+    for (i = 0; i < d.len; i += TARGET_PAGE_SIZE) {
+        tb_flush_jmp_cache(cpu, d.addr + i);
     }
-    return false;
 }
 
-static TLBFlushPageBitsByMMUIdxData
-decode_runon_to_pbm(run_on_cpu_data data)
+static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
+                                              run_on_cpu_data data)
 {
-    target_ulong addr_map_bits = (target_ulong) data.target_ptr;
-    return (TLBFlushPageBitsByMMUIdxData){
-        .addr = addr_map_bits & TARGET_PAGE_MASK,
-        .idxmap = (addr_map_bits & ~TARGET_PAGE_MASK) >> 6,
-        .bits = addr_map_bits & 0x3f
-    };
+    TLBFlushRangeData *d = data.host_ptr;
+    tlb_flush_range_by_mmuidx_async_0(cpu, *d);
+    g_free(d);
 }
 
-static void tlb_flush_page_bits_by_mmuidx_async_1(CPUState *cpu,
-                                                  run_on_cpu_data runon)
+/*
+ * Return false if the flush devolves to a simpler one, which has then
+ * been done on @cpu or scheduled on all cpus.
+ */
+static bool tlb_flush_range_prepare(TLBFlushRangeData *d, target_ulong addr,
+                                    target_ulong len, uint16_t idxmap,
+                                    unsigned bits)
 {
-    tlb_flush_page_bits_by_mmuidx_async_0(cpu, decode_runon_to_pbm(runon));
-}
+    /* This should already be page aligned */
+    d->addr = addr & TARGET_PAGE_MASK;
+    d->len = ROUND_UP(len + (addr & ~TARGET_PAGE_MASK), TARGET_PAGE_SIZE);
+    d->idxmap = idxmap;
+    d->bits = MIN(bits, TARGET_LONG_BITS);
 
-static void tlb_flush_page_bits_by_mmuidx_async_2(CPUState *cpu,
-                                                  run_on_cpu_data data)
-{
-    TLBFlushPageBitsByMMUIdxData *d = data.host_ptr;
-    tlb_flush_page_bits_by_mmuidx_async_0(cpu, *d);
-    g_free(d);
+    /*
+     * If no page bits are significant, or the range covers the whole
+     * address space, this devolves to tlb_flush.
+     */
+    return d->len != 0 && d->len >= len && bits >= TARGET_PAGE_BITS;
 }
 
-void tlb_flush_page_bits_by_mmuidx(CPUState *cpu, target_ulong addr,
-                                   uint16_t idxmap, unsigned bits)
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap,
+                               unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
+    TLBFlushRangeData d;
 
-    /* If all bits are significant, this devolves to tlb_flush_page. */
-    if (bits >= TARGET_LONG_BITS) {
-        tlb_flush_page_by_mmuidx(cpu, addr, idxmap);
+    if (!tlb_flush_range_prepare(&d, addr, len, idxmap, bits)) {
+        tlb_flush_by_mmuidx(cpu, idxmap);
         return;
     }
-    /* If no page bits are significant, this devolves to tlb_flush. */
-    if (bits < TARGET_PAGE_BITS) {
-        tlb_flush_by_mmuidx(cpu, idxmap);
+    /* A single page with all bits significant is tlb_flush_page. */
+    if (d.bits == TARGET_LONG_BITS && d.len == TARGET_PAGE_SIZE) {
+        tlb_flush_page_by_mmuidx(cpu, d.addr, idxmap);
         return;
     }
 
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
     if (qemu_cpu_is_self(cpu)) {
-        tlb_flush_page_bits_by_mmuidx_async_0(cpu, d);
-    } else if (encode_pbm_to_runon(&runon, d)) {
-        async_run_on_cpu(cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
+        tlb_flush_range_by_mmuidx_async_0(cpu, d);
     } else {
-        TLBFlushPageBitsByMMUIdxData *p
-            = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-
         /* Otherwise allocate a structure, freed by the worker.  */
-        *p = d;
-        async_run_on_cpu(cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(p));
+        async_run_on_cpu(cpu, tlb_flush_range_by_mmuidx_async_1,
+                         RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
     }
 }
 
-void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *src_cpu,
-                                            target_ulong addr,
-                                            uint16_t idxmap,
-                                            unsigned bits)
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
+                                        target_ulong addr,
+                                        target_ulong len,
+                                        uint16_t idxmap,
+                                        unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
+    TLBFlushRangeData d;
+    CPUState *dst_cpu;
 
-    /* If all bits are significant, this devolves to tlb_flush_page. */
-    if (bits >= TARGET_LONG_BITS) {
-        tlb_flush_page_by_mmuidx_all_cpus(src_cpu, addr, idxmap);
+    if (!tlb_flush_range_prepare(&d, addr, len, idxmap, bits)) {
+        tlb_flush_by_mmuidx_all_cpus(src_cpu, idxmap);
         return;
     }
-    /* If no page bits are significant, this devolves to tlb_flush. */
-    if (bits < TARGET_PAGE_BITS) {
-        tlb_flush_by_mmuidx_all_cpus(src_cpu, idxmap);
+    if (d.bits == TARGET_LONG_BITS && d.len == TARGET_PAGE_SIZE) {
+        tlb_flush_page_by_mmuidx_all_cpus(src_cpu, d.addr, idxmap);
         return;
     }
 
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (encode_pbm_to_runon(&runon, d)) {
-        flush_all_helper(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageBitsByMMUIdxData *p;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-                *p = d;
-                async_run_on_cpu(dst_cpu,
-                                 tlb_flush_page_bits_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(p));
-            }
+    /* Allocate a separate data block for each destination cpu.  */
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
+                             RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
         }
     }
 
-    tlb_flush_page_bits_by_mmuidx_async_0(src_cpu, d);
+    tlb_flush_range_by_mmuidx_async_0(src_cpu, d);
 }
 
-void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
-                                                   target_ulong addr,
-                                                   uint16_t idxmap,
-                                                   unsigned bits)
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap,
+                                               unsigned bits)
 {
-    TLBFlushPageBitsByMMUIdxData d;
-    run_on_cpu_data runon;
+    TLBFlushRangeData d;
+    CPUState *dst_cpu;
 
-    /* If all bits are significant, this devolves to tlb_flush_page. */
-    if (bits >= TARGET_LONG_BITS) {
-        tlb_flush_page_by_mmuidx_all_cpus_synced(src_cpu, addr, idxmap);
+    if (!tlb_flush_range_prepare(&d, addr, len, idxmap, bits)) {
+        tlb_flush_by_mmuidx_all_cpus_synced(src_cpu, idxmap);
         return;
     }
-    /* If no page bits are significant, this devolves to tlb_flush. */
-    if (bits < TARGET_PAGE_BITS) {
-        tlb_flush_by_mmuidx_all_cpus_synced(src_cpu, idxmap);
+    if (d.bits == TARGET_LONG_BITS && d.len == TARGET_PAGE_SIZE) {
+        tlb_flush_page_by_mmuidx_all_cpus_synced(src_cpu, d.addr, idxmap);
         return;
     }
 
-    /* This should already be page aligned */
-    d.addr = addr & TARGET_PAGE_MASK;
-    d.idxmap = idxmap;
-    d.bits = bits;
-
-    if (encode_pbm_to_runon(&runon, d)) {
-        flush_all_helper(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1, runon);
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_bits_by_mmuidx_async_1,
-                              runon);
-    } else {
-        CPUState *dst_cpu;
-        TLBFlushPageBitsByMMUIdxData *p;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-                *p = d;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(p));
-            }
+    /* Allocate a separate data block for each destination cpu.  */
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
+                             RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
         }
-
-        p = g_new(TLBFlushPageBitsByMMUIdxData, 1);
-        *p = d;
-        async_safe_run_on_cpu(src_cpu, tlb_flush_page_bits_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(p));
     }
+
+    async_safe_run_on_cpu(src_cpu, tlb_flush_range_by_mmuidx_async_1,
+                          RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
+}
+
+void tlb_flush_page_bits_by_mmuidx(CPUState *cpu, target_ulong addr,
+                                   uint16_t idxmap, unsigned bits)
+{
+    tlb_flush_range_by_mmuidx(cpu, addr, TARGET_PAGE_SIZE, idxmap, bits);
+}
+
+void tlb_flush_page_bits_by_mmuidx_all_cpus(CPUState *src_cpu,
+                                            target_ulong addr,
+                                            uint16_t idxmap,
+                                            unsigned bits)
+{
+    tlb_flush_range_by_mmuidx_all_cpus(src_cpu, addr, TARGET_PAGE_SIZE,
+                                       idxmap, bits);
+}
+
+void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                                   target_ulong addr,
+                                                   uint16_t idxmap,
+                                                   unsigned bits)
+{
+    tlb_flush_range_by_mmuidx_all_cpus_synced(src_cpu, addr, TARGET_PAGE_SIZE,
+                                              idxmap, bits);
 }
 
 /* update the TLBs so that writes to code in the virtual page 'addr'
@@ -1067,40 +1166,129 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
-static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
-                               target_ulong vaddr, target_ulong size)
+/*
+ * Our TLB only holds TARGET_PAGE_SIZE entries, so remember the large
+ * pages separately: this lets us flush only the entries of a large page
+ * when a page within it is invalidated, and refill the other pages of a
+ * large page without walking the guest page tables again.
+ *
+ * Called with tlb_c.lock held.
+ */
+static void tlb_add_large_page_locked(CPUArchState *env, int mmu_idx,
+                                      target_ulong vaddr, hwaddr paddr,
+                                      MemTxAttrs attrs, int prot,
+                                      target_ulong size, bool contiguous)
 {
-    target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
     target_ulong lp_mask = ~(size - 1);
+    target_ulong lp_addr = vaddr & lp_mask;
+    CPUTLBLargeEntry *lp = NULL;
+    int i;
 
-    if (lp_addr == (target_ulong)-1) {
-        /* No previous large page.  */
-        lp_addr = vaddr;
-    } else {
-        /* Extend the existing region to include the new page.
-           This is a compromise between unnecessary flushes and
-           the cost of maintaining a full variable size TLB.  */
-        lp_mask &= env_tlb(env)->d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ vaddr) & lp_mask) != 0) {
-            lp_mask <<= 1;
+    for (i = 0; i < CPU_LTLB_SIZE; i++) {
+        CPUTLBLargeEntry *e = &d->ltable[i];
+
+        if (e->vaddr == lp_addr && e->mask == lp_mask) {
+            /* Same page, e.g. now writable: just update it.  */
+            lp = e;
+            goto fill;
         }
     }
-    env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
+
+    for (i = 0; i < CPU_LTLB_SIZE; i++) {
+        CPUTLBLargeEntry *e = &d->ltable[i];
+
+        if (e->vaddr == (target_ulong)-1) {
+            lp = lp ? lp : e;
+        } else if (((e->vaddr ^ lp_addr) & e->mask & lp_mask) == 0) {
+            /* The mapping changed size; drop the old one.  */
+            tlb_flush_large_page_locked(env, mmu_idx, e);
+            lp = lp ? lp : e;
+        }
+    }
+    if (!lp) {
+        lp = &d->ltable[d->lindex++ % CPU_LTLB_SIZE];
+        tlb_flush_large_page_locked(env, mmu_idx, lp);
+    }
+    d->n_large_pages++;
+
+ fill:
+    lp->vaddr = lp_addr;
+    lp->mask = lp_mask;
+    lp->paddr = (paddr & TARGET_PAGE_MASK) -
+                ((vaddr & TARGET_PAGE_MASK) - lp_addr);
+    lp->attrs = attrs;
+    lp->prot = prot;
+    lp->contiguous = contiguous;
+}
+
+/*
+ * Refill the entry for @addr from the large page containing it, if that
+ * large page maps contiguously and grants @access_type.  Return false if
+ * tlb_fill is needed.
+ */
+static bool tlb_fill_large_page(CPUState *cpu, target_ulong addr,
+                                MMUAccessType access_type, int mmu_idx)
+{
+    CPUArchState *env = cpu->env_ptr;
+    CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    CPUTLBLargeEntry *lp;
+    int need, i;
+
+    if (!d->n_large_pages) {
+        return false;
+    }
+
+    switch (access_type) {
+    case MMU_DATA_STORE:
+        need = PAGE_WRITE;
+        break;
+    case MMU_INST_FETCH:
+        need = PAGE_EXEC;
+        break;
+    default:
+        need = PAGE_READ;
+        break;
+    }
+
+    /* Only the owning vCPU modifies ltable, so no need for the lock.  */
+    for (i = 0; i < CPU_LTLB_SIZE; i++) {
+        lp = &d->ltable[i];
+        if ((page & lp->mask) == lp->vaddr) {
+            /*
+             * Without the permission, let the target decide whether it
+             * faults or e.g. updates the dirty bit of the page table entry.
+             */
+            if (!lp->contiguous ||
+                !(lp->prot & need) || (lp->prot & PAGE_WRITE_INV)) {
+                return false;
+            }
+            tlb_set_large_page_with_attrs(cpu, page,
+                                          lp->paddr + (page - lp->vaddr),
+                                          lp->attrs, lp->prot, mmu_idx,
+                                          -lp->mask);
+            qatomic_set(&env_tlb(env)->c.large_fill_count,
+                        env_tlb(env)->c.large_fill_count + 1);
+            return true;
+        }
+    }
+    return false;
 }
 
 /* Add a new TLB entry. At most one entry for a given virtual address
- * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
- * supplied size is only used by tlb_flush_page.
+ * is permitted. Only a single TARGET_PAGE_SIZE region is mapped; if
+ * the supplied size is larger, the large page is remembered so that
+ * its pages are flushed together and, if @contiguous, so that its other
+ * pages can be mapped on demand.
  *
  * Called from TCG-generated code, which is under an RCU read-side
  * critical section.
  */
-void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
-                             hwaddr paddr, MemTxAttrs attrs, int prot,
-                             int mmu_idx, target_ulong size)
+static void tlb_set_page_internal(CPUState *cpu, target_ulong vaddr,
+                                  hwaddr paddr, MemTxAttrs attrs, int prot,
+                                  int mmu_idx, target_ulong size,
+                                  bool contiguous)
 {
     CPUArchState *env = cpu->env_ptr;
     CPUTLB *tlb = env_tlb(env);
@@ -1114,6 +1302,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     hwaddr iotlb, xlat, sz, paddr_page;
     target_ulong vaddr_page;
     int asidx = cpu_asidx_from_attrs(cpu, attrs);
+    int orig_prot = prot;
     int wp_flags;
     bool is_ram, is_romd;
 
@@ -1122,7 +1311,6 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     if (size <= TARGET_PAGE_SIZE) {
         sz = TARGET_PAGE_SIZE;
     } else {
-        tlb_add_large_page(env, mmu_idx, vaddr, size);
         sz = size;
     }
     vaddr_page = vaddr & TARGET_PAGE_MASK;
@@ -1202,6 +1390,12 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     /* Note that the tlb is no longer clean.  */
     tlb->c.dirty |= 1 << mmu_idx;
 
+    if (size > TARGET_PAGE_SIZE) {
+        /* The iommu may restrict prot; that is redone on every refill.  */
+        tlb_add_large_page_locked(env, mmu_idx, vaddr, paddr, attrs,
+                                  orig_prot, size, contiguous);
+    }
+
     /* Make sure there's no cached translation for the new page.  */
     tlb_flush_vtlb_page_locked(env, mmu_idx, vaddr_page);
 
@@ -1268,6 +1462,22 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     qemu_spin_unlock(&tlb->c.lock);
 }
 
+void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
+                             hwaddr paddr, MemTxAttrs attrs, int prot,
+                             int mmu_idx, target_ulong size)
+{
+    tlb_set_page_internal(cpu, vaddr, paddr, attrs, prot, mmu_idx, size,
+                          false);
+}
+
+void tlb_set_large_page_with_attrs(CPUState *cpu, target_ulong vaddr,
+                                   hwaddr paddr, MemTxAttrs attrs, int prot,
+                                   int mmu_idx, target_ulong size)
+{
+    tlb_set_page_internal(cpu, vaddr, paddr, attrs, prot, mmu_idx, size,
+                          true);
+}
+
 /* Add a new TLB entry, but without specifying the memory
  * transaction attributes to be used.
  */
@@ -1302,6 +1512,10 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
     CPUClass *cc = CPU_GET_CLASS(cpu);
     bool ok;
 
+    if (tlb_fill_large_page(cpu, addr, access_type, mmu_idx)) {
+        return;
+    }
+
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
@@ -1552,7 +1766,9 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
 
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
-    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
+    /* Writes next to the code of a page need not lock it */
+    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE) &&
+        !tb_invalidate_phys_page_unneeded(ram_addr, size)) {
         struct page_collection *pages
             = page_collection_lock(ram_addr, ram_addr + size);
         tb_invalidate_phys_page_fast(pages, ram_addr, size, retaddr);
@@ -1604,7 +1820,8 @@ static int probe_access_internal(CPUArchState *env, target_ulong addr,
             CPUState *cs = env_cpu(env);
             CPUClass *cc = CPU_GET_CLASS(cs);
 
-            if (!cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
+            if (!tlb_fill_large_page(cs, addr, access_type, mmu_idx) &&
+                !cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
                                        mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
                 *phost = NULL;
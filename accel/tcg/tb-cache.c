@@ -0,0 +1,792 @@
+/*
+ * Persistent cache of translation blocks
+ *
+ * The host code of the translation blocks is saved to a file when QEMU
+ * exits, and reused instead of translating the guest code again by the
+ * next run of the same QEMU binary with the same machine configuration.
+ *
+ * Each saved TB carries a hash of the guest code it was translated from,
+ * so that a TB is only reused if the guest code at the same physical
+ * address did not change, together with the list of the references of
+ * its code to host addresses recorded by the TCG backend.  These are
+ * classified by what they point to (QEMU binary, prologue, the TB
+ * itself) and relocated when the TB is restored; a TB which refers to
+ * any other mapped host memory, like the heap, is not saved.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu-version.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/tb-hash.h"
+#include "tcg/tcg.h"
+#include "hw/boards.h"
+#include "sysemu/sysemu.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "qemu/qemu-print.h"
+#include "qemu/cacheflush.h"
+#include "qemu/xxhash.h"
+#include "qemu/rcu.h"
+#include "tb-cache.h"
+#include "trace.h"
+
+bool tb_cache_enabled;
+
+#if defined(TCG_TARGET_EXT_REFS) && defined(CONFIG_LINUX)
+
+#include <link.h>
+#ifdef CONFIG_CPUID_H
+#include "qemu/cpuid.h"
+#endif
+
+#define TB_CACHE_MAGIC      0x4548434143425451ULL /* "QTBCACHE" */
+#define TB_CACHE_VERSION    1
+#define TB_CACHE_KEY_LEN    32
+
+/* Below this, a value cannot be a host address */
+#define TB_CACHE_MIN_ADDR   0x10000
+
+typedef struct TBCacheHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t nb_entries;
+    uint8_t key[TB_CACHE_KEY_LEN];
+} TBCacheHeader;
+
+/*
+ * A saved TB, followed by its code and search data padded to 8 bytes,
+ * then by its references.  The first fields are the lookup key.
+ */
+typedef struct TBCacheEntry {
+    uint64_t phys_pc;
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint32_t trace_vcpu_dstate;
+    uint16_t size;
+    uint16_t icount;
+    uint64_t guest_hash;
+    uint16_t jmp_reset_offset[2];
+    uint32_t jmp_target_arg[2];
+    uint32_t code_size;
+    uint32_t search_size;
+    uint32_t nb_refs;
+    uint32_t unused;
+} TBCacheEntry;
+
+typedef enum TBCacheBase {
+    TB_CACHE_BASE_NONE,     /* a constant */
+    TB_CACHE_BASE_IMAGE,    /* the QEMU executable */
+    TB_CACHE_BASE_BUFFER,   /* the prologue */
+    TB_CACHE_BASE_TB,       /* the TranslationBlock structure */
+    TB_CACHE_BASE_CODE,     /* the code of the TB */
+    TB_CACHE_BASE__MAX,
+} TBCacheBase;
+
+typedef struct TBCacheRef {
+    uint32_t offset;
+    uint8_t kind;           /* TCGExtRefKind */
+    int8_t addend;
+    uint8_t base;           /* TBCacheBase */
+    uint8_t unused;
+    int64_t value;          /* relative to the base */
+} TBCacheRef;
+
+QEMU_BUILD_BUG_ON(sizeof(TBCacheHeader) % 8);
+QEMU_BUILD_BUG_ON(sizeof(TBCacheEntry) % 8);
+QEMU_BUILD_BUG_ON(sizeof(TBCacheRef) % 8);
+
+static struct {
+    char *path;
+    uint8_t key[TB_CACHE_KEY_LEN];
+    Notifier init_done;
+    Notifier exit;
+
+    /* The extent and load bias of the QEMU executable */
+    uintptr_t image_start;
+    uintptr_t image_end;
+    uintptr_t image_bias;
+
+    /* The contents of the file, and the index of its entries */
+    gchar *data;
+    GHashTable *loaded;
+
+    /* The TBs translated by this run */
+    QemuMutex lock;
+    GHashTable *recorded;
+    size_t recorded_bytes;
+
+    /* Statistics */
+    size_t nb_loaded;
+    size_t lookups;
+    size_t hits;
+    size_t stale;
+    size_t rejected;
+    size_t nb_recorded;
+    size_t uncacheable;
+} tb_cache;
+
+static uint8_t *tb_cache_entry_code(const TBCacheEntry *e)
+{
+    return (uint8_t *)(e + 1);
+}
+
+static TBCacheRef *tb_cache_entry_refs(const TBCacheEntry *e)
+{
+    return (TBCacheRef *)(tb_cache_entry_code(e) +
+                          ROUND_UP((uint64_t)e->code_size + e->search_size, 8));
+}
+
+static uint64_t tb_cache_entry_size(const TBCacheEntry *e)
+{
+    return sizeof(*e) + ROUND_UP((uint64_t)e->code_size + e->search_size, 8) +
+           (uint64_t)e->nb_refs * sizeof(TBCacheRef);
+}
+
+static guint tb_cache_entry_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return tb_hash_func(e->phys_pc, e->pc, e->flags, e->cflags,
+                        e->trace_vcpu_dstate);
+}
+
+static gboolean tb_cache_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *x = a, *y = b;
+
+    return x->phys_pc == y->phys_pc && x->pc == y->pc &&
+           x->cs_base == y->cs_base && x->flags == y->flags &&
+           x->cflags == y->cflags &&
+           x->trace_vcpu_dstate == y->trace_vcpu_dstate;
+}
+
+static void tb_cache_entry_set_key(TBCacheEntry *e,
+                                   const TranslationBlock *tb,
+                                   tb_page_addr_t phys_pc)
+{
+    e->phys_pc = phys_pc;
+    e->pc = tb->pc;
+    e->cs_base = tb->cs_base;
+    e->flags = tb->flags;
+    e->cflags = tb->cflags;
+    e->trace_vcpu_dstate = tb->trace_vcpu_dstate;
+}
+
+/* xxhash64 of the guest code of a TB */
+static uint64_t tb_cache_hash_code(const uint8_t *buf, size_t len)
+{
+    uint64_t h = QEMU_XXHASH_SEED + XXH_PRIME64_5 + len;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        h ^= XXH64_round(0, ldq_le_p(buf + i));
+        h = rol64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    for (; i < len; i++) {
+        h ^= buf[i] * XXH_PRIME64_5;
+        h = rol64(h, 11) * XXH_PRIME64_1;
+    }
+    return XXH64_avalanche(h);
+}
+
+static uint64_t tb_cache_guest_hash(tb_page_addr_t phys_pc, size_t len)
+{
+    RCU_READ_LOCK_GUARD();
+
+    return tb_cache_hash_code(qemu_map_ram_ptr(NULL, phys_pc), len);
+}
+
+/*
+ * The translator consults the breakpoints and the plugins, which are
+ * not part of the key; do not use the cache while they are active.
+ */
+static bool tb_cache_usable(CPUState *cpu, uint32_t cflags)
+{
+    if (cflags & CF_NOCACHE) {
+        return false;
+    }
+    if (cpu->singlestep_enabled || singlestep ||
+        !QTAILQ_EMPTY(&cpu->breakpoints)) {
+        return false;
+    }
+#ifdef CONFIG_PLUGIN
+    if (test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS, cpu->plugin_mask)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+static uintptr_t tb_cache_base(TBCacheBase base, const TranslationBlock *tb)
+{
+    switch (base) {
+    case TB_CACHE_BASE_NONE:
+        return 0;
+    case TB_CACHE_BASE_IMAGE:
+        return tb_cache.image_bias;
+    case TB_CACHE_BASE_BUFFER:
+        return (uintptr_t)tcg_splitwx_to_rx(tcg_init_ctx.code_gen_buffer);
+    case TB_CACHE_BASE_TB:
+        return (uintptr_t)tcg_splitwx_to_rx((void *)tb);
+    case TB_CACHE_BASE_CODE:
+        return (uintptr_t)tb->tc.ptr;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static bool tb_cache_is_mapped(uintptr_t addr)
+{
+    unsigned char vec;
+
+    if (addr < TB_CACHE_MIN_ADDR) {
+        return false;
+    }
+    return mincore((void *)(addr & qemu_real_host_page_mask),
+                   qemu_real_host_page_size, &vec) == 0 || errno != ENOMEM;
+}
+
+/*
+ * Express @value, which the code of @tb refers to, relative to something
+ * that exists in the next run too.  Return false if there is none.
+ */
+static bool tb_cache_classify(TBCacheRef *ref, uintptr_t value,
+                              const TranslationBlock *tb)
+{
+    uintptr_t buffer = tb_cache_base(TB_CACHE_BASE_BUFFER, tb);
+
+    if (value - (uintptr_t)tb->tc.ptr <= tb->tc.size) {
+        ref->base = TB_CACHE_BASE_CODE;
+    } else if (value - tb_cache_base(TB_CACHE_BASE_TB, tb) <
+               sizeof(TranslationBlock)) {
+        ref->base = TB_CACHE_BASE_TB;
+    } else if (value - tb_cache.image_start <
+               tb_cache.image_end - tb_cache.image_start) {
+        ref->base = TB_CACHE_BASE_IMAGE;
+    } else if (value - buffer < tcg_init_ctx.code_gen_buffer_size) {
+        /* Other TBs are only reached through the jump lists */
+        ref->base = TB_CACHE_BASE_BUFFER;
+    } else if (!tb_cache_is_mapped(value)) {
+        ref->base = TB_CACHE_BASE_NONE;
+    } else {
+        return false;
+    }
+    ref->value = value - tb_cache_base(ref->base, tb);
+    return true;
+}
+
+static bool tb_cache_relocate(const TBCacheEntry *e, TranslationBlock *tb,
+                              void *buf)
+{
+    const TBCacheRef *ref = tb_cache_entry_refs(e);
+    uint32_t i;
+
+    for (i = 0; i < e->nb_refs; i++, ref++) {
+        uintptr_t value = tb_cache_base(ref->base, tb) + ref->value;
+        void *field = buf + ref->offset;
+        intptr_t disp;
+
+        switch (ref->kind) {
+        case TCG_EXT_REF_ABS64:
+            stq_he_p(field, value);
+            break;
+        case TCG_EXT_REF_ABS32U:
+            if (value != (uint32_t)value) {
+                return false;
+            }
+            stl_he_p(field, value);
+            break;
+        case TCG_EXT_REF_ABS32S:
+            if (value != (intptr_t)(int32_t)value) {
+                return false;
+            }
+            stl_he_p(field, value);
+            break;
+        case TCG_EXT_REF_PCREL32:
+            disp = value - ((uintptr_t)tb->tc.ptr + ref->offset + ref->addend);
+            if (disp != (int32_t)disp) {
+                return false;
+            }
+            stl_he_p(field, disp);
+            break;
+        default:
+            g_assert_not_reached();
+        }
+    }
+    return true;
+}
+
+int tb_cache_restore(CPUState *cpu, TranslationBlock *tb,
+                     tb_page_addr_t phys_pc, int *search_size)
+{
+    GHashTable *loaded = qatomic_rcu_read(&tb_cache.loaded);
+    void *buf = tcg_splitwx_to_rw(tb->tc.ptr);
+    TBCacheEntry key;
+    const TBCacheEntry *e;
+
+    if (!loaded || !tb_cache_usable(cpu, tb->cflags)) {
+        return 0;
+    }
+
+    qatomic_inc(&tb_cache.lookups);
+    tb_cache_entry_set_key(&key, tb, phys_pc);
+    e = g_hash_table_lookup(loaded, &key);
+    if (!e) {
+        return 0;
+    }
+    if (tb_cache_guest_hash(phys_pc, e->size) != e->guest_hash) {
+        qatomic_inc(&tb_cache.stale);
+        return 0;
+    }
+    if (unlikely(buf + e->code_size + e->search_size >
+                 tcg_ctx->code_gen_highwater)) {
+        return -1;
+    }
+
+    memcpy(buf, tb_cache_entry_code(e), e->code_size + e->search_size);
+    if (!tb_cache_relocate(e, tb, buf)) {
+        qatomic_inc(&tb_cache.rejected);
+        return 0;
+    }
+    flush_idcache_range((uintptr_t)tb->tc.ptr, (uintptr_t)buf, e->code_size);
+
+    tb->size = e->size;
+    tb->icount = e->icount;
+    tb->tc.size = e->code_size;
+    tb->jmp_reset_offset[0] = e->jmp_reset_offset[0];
+    tb->jmp_reset_offset[1] = e->jmp_reset_offset[1];
+    tb->jmp_target_arg[0] = e->jmp_target_arg[0];
+    tb->jmp_target_arg[1] = e->jmp_target_arg[1];
+    *search_size = e->search_size;
+
+    qatomic_inc(&tb_cache.hits);
+    return e->code_size;
+}
+
+/*
+ * Whether @table has an entry for @key whose guest code is unchanged;
+ * called with tb_cache.lock held for the recorded entries.
+ */
+static bool tb_cache_has_entry(GHashTable *table, const TBCacheEntry *key,
+                               uint64_t guest_hash)
+{
+    const TBCacheEntry *e = table ? g_hash_table_lookup(table, key) : NULL;
+
+    return e && e->guest_hash == guest_hash;
+}
+
+void tb_cache_record(CPUState *cpu, TranslationBlock *tb,
+                     tb_page_addr_t phys_pc, int search_size)
+{
+    TCGContext *s = tcg_ctx;
+    const TBCacheEntry *old;
+    TBCacheEntry key, *e;
+    TBCacheRef *ref;
+    uint64_t size, old_size, guest_hash;
+    bool known;
+    int i;
+
+    if (!tb_cache_usable(cpu, tb->cflags) || s->nb_ext_refs < 0 ||
+        !TCG_TARGET_HAS_direct_jump) {
+        goto uncacheable;
+    }
+
+    /*
+     * A TB that is already in the file, or that this run recorded, is
+     * translated again after a flush or an invalidation of its page;
+     * keep the existing entry unless the guest code changed.
+     */
+    tb_cache_entry_set_key(&key, tb, phys_pc);
+    guest_hash = tb_cache_guest_hash(phys_pc, tb->size);
+    qemu_mutex_lock(&tb_cache.lock);
+    known = tb_cache_has_entry(qatomic_rcu_read(&tb_cache.loaded), &key,
+                               guest_hash) ||
+            tb_cache_has_entry(tb_cache.recorded, &key, guest_hash);
+    qemu_mutex_unlock(&tb_cache.lock);
+    if (known) {
+        return;
+    }
+
+    e = g_malloc0(sizeof(*e) + ROUND_UP(tb->tc.size + search_size, 8) +
+                  s->nb_ext_refs * sizeof(TBCacheRef));
+    tb_cache_entry_set_key(e, tb, phys_pc);
+    e->size = tb->size;
+    e->icount = tb->icount;
+    e->guest_hash = guest_hash;
+    e->jmp_reset_offset[0] = tb->jmp_reset_offset[0];
+    e->jmp_reset_offset[1] = tb->jmp_reset_offset[1];
+    e->jmp_target_arg[0] = tb->jmp_target_arg[0];
+    e->jmp_target_arg[1] = tb->jmp_target_arg[1];
+    e->code_size = tb->tc.size;
+    e->search_size = search_size;
+    e->nb_refs = s->nb_ext_refs;
+    memcpy(tb_cache_entry_code(e), tcg_splitwx_to_rw(tb->tc.ptr),
+           e->code_size + e->search_size);
+
+    ref = tb_cache_entry_refs(e);
+    for (i = 0; i < s->nb_ext_refs; i++, ref++) {
+        ref->offset = s->ext_refs[i].offset;
+        ref->kind = s->ext_refs[i].kind;
+        ref->addend = s->ext_refs[i].addend;
+        if (!tb_cache_classify(ref, s->ext_refs[i].value, tb)) {
+            g_free(e);
+            goto uncacheable;
+        }
+    }
+
+    size = tb_cache_entry_size(e);
+    qemu_mutex_lock(&tb_cache.lock);
+    old = g_hash_table_lookup(tb_cache.recorded, e);
+    if (old && old->guest_hash == e->guest_hash) {
+        /* Another vCPU recorded it meanwhile */
+        qemu_mutex_unlock(&tb_cache.lock);
+        g_free(e);
+        return;
+    }
+    old_size = old ? tb_cache_entry_size(old) : 0;
+    if (tb_cache.recorded_bytes - old_size + size > tcg_code_capacity()) {
+        qemu_mutex_unlock(&tb_cache.lock);
+        g_free(e);
+        goto uncacheable;
+    }
+    if (old) {
+        /* The guest code changed; g_hash_table_add() frees the old entry */
+        tb_cache.recorded_bytes -= old_size;
+        tb_cache.nb_recorded--;
+    }
+    g_hash_table_add(tb_cache.recorded, e);
+    tb_cache.recorded_bytes += size;
+    tb_cache.nb_recorded++;
+    qemu_mutex_unlock(&tb_cache.lock);
+    return;
+
+ uncacheable:
+    qatomic_inc(&tb_cache.uncacheable);
+}
+
+static bool tb_cache_entry_valid(const TBCacheEntry *e)
+{
+    const TBCacheRef *ref = tb_cache_entry_refs(e);
+    static const unsigned ref_size[] = {
+        [TCG_EXT_REF_ABS64] = 8,
+        [TCG_EXT_REF_ABS32U] = 4,
+        [TCG_EXT_REF_ABS32S] = 4,
+        [TCG_EXT_REF_PCREL32] = 4,
+    };
+    uint32_t i;
+
+    if (e->size == 0 || e->icount == 0 || e->icount > TCG_MAX_INSNS ||
+        (e->pc & ~TARGET_PAGE_MASK) + e->size > TARGET_PAGE_SIZE ||
+        e->code_size == 0 || e->code_size > UINT16_MAX ||
+        e->search_size > TCG_MAX_INSNS * (TARGET_INSN_START_WORDS + 1) * 10 ||
+        e->nb_refs > TCG_MAX_EXT_REFS) {
+        return false;
+    }
+    for (i = 0; i < 2; i++) {
+        if (e->jmp_reset_offset[i] != TB_JMP_RESET_OFFSET_INVALID &&
+            (e->jmp_reset_offset[i] >= e->code_size ||
+             e->jmp_target_arg[i] + 4 > e->code_size)) {
+            return false;
+        }
+    }
+    for (i = 0; i < e->nb_refs; i++, ref++) {
+        if (ref->kind >= ARRAY_SIZE(ref_size) ||
+            ref->base >= TB_CACHE_BASE__MAX ||
+            (uint64_t)ref->offset + ref_size[ref->kind] > e->code_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void tb_cache_load(void)
+{
+    g_autoptr(GError) gerr = NULL;
+    const TBCacheHeader *hdr;
+    GHashTable *loaded;
+    gsize len, pos;
+    uint32_t i;
+
+    if (!g_file_get_contents(tb_cache.path, &tb_cache.data, &len, &gerr)) {
+        if (!g_error_matches(gerr, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            warn_report("tb-cache: %s", gerr->message);
+        }
+        return;
+    }
+
+    hdr = (const TBCacheHeader *)tb_cache.data;
+    if (len < sizeof(*hdr) || hdr->magic != TB_CACHE_MAGIC ||
+        hdr->version != TB_CACHE_VERSION ||
+        memcmp(hdr->key, tb_cache.key, TB_CACHE_KEY_LEN)) {
+        /* Another binary or configuration, the file will be replaced */
+        trace_tb_cache_load(tb_cache.path, 0);
+        goto out;
+    }
+
+    loaded = g_hash_table_new(tb_cache_entry_hash, tb_cache_entry_equal);
+    pos = sizeof(*hdr);
+    for (i = 0; i < hdr->nb_entries; i++) {
+        const TBCacheEntry *e = (const TBCacheEntry *)(tb_cache.data + pos);
+
+        if (len - pos < sizeof(*e) || len - pos < tb_cache_entry_size(e) ||
+            !tb_cache_entry_valid(e)) {
+            warn_report("tb-cache: %s is corrupted, ignoring it",
+                        tb_cache.path);
+            g_hash_table_destroy(loaded);
+            goto out;
+        }
+        g_hash_table_add(loaded, (gpointer)e);
+        pos += tb_cache_entry_size(e);
+    }
+
+    tb_cache.nb_loaded = g_hash_table_size(loaded);
+    trace_tb_cache_load(tb_cache.path, tb_cache.nb_loaded);
+    qatomic_rcu_set(&tb_cache.loaded, loaded);
+    return;
+
+out:
+    g_free(tb_cache.data);
+    tb_cache.data = NULL;
+}
+
+static void tb_cache_save_entry(GByteArray *buf, const TBCacheEntry *e)
+{
+    g_byte_array_append(buf, (const guint8 *)e, tb_cache_entry_size(e));
+}
+
+static void tb_cache_save(Notifier *notifier, void *data)
+{
+    g_autoptr(GError) gerr = NULL;
+    GByteArray *buf = g_byte_array_new();
+    TBCacheHeader *hdr;
+    GHashTableIter iter;
+    gpointer e;
+    uint32_t nb_entries = 0;
+
+    g_byte_array_set_size(buf, sizeof(*hdr));
+
+    qemu_mutex_lock(&tb_cache.lock);
+    if (tb_cache.loaded) {
+        g_hash_table_iter_init(&iter, tb_cache.loaded);
+        while (g_hash_table_iter_next(&iter, &e, NULL)) {
+            if (!g_hash_table_contains(tb_cache.recorded, e)) {
+                tb_cache_save_entry(buf, e);
+                nb_entries++;
+            }
+        }
+    }
+    g_hash_table_iter_init(&iter, tb_cache.recorded);
+    while (g_hash_table_iter_next(&iter, &e, NULL)) {
+        tb_cache_save_entry(buf, e);
+        nb_entries++;
+    }
+    qemu_mutex_unlock(&tb_cache.lock);
+
+    hdr = (TBCacheHeader *)buf->data;
+    hdr->magic = TB_CACHE_MAGIC;
+    hdr->version = TB_CACHE_VERSION;
+    hdr->nb_entries = nb_entries;
+    memcpy(hdr->key, tb_cache.key, TB_CACHE_KEY_LEN);
+
+    if (!g_file_set_contents(tb_cache.path, (const gchar *)buf->data,
+                             buf->len, &gerr)) {
+        warn_report("tb-cache: %s", gerr->message);
+    } else {
+        trace_tb_cache_save(tb_cache.path, nb_entries);
+    }
+    g_byte_array_unref(buf);
+}
+
+static void tb_cache_key_add(GChecksum *ck, const void *data, size_t len)
+{
+    g_checksum_update(ck, data, len);
+}
+
+static void tb_cache_key_add_str(GChecksum *ck, const char *str)
+{
+    tb_cache_key_add(ck, str, strlen(str) + 1);
+}
+
+/*
+ * The key identifies what the generated code depends on, other than the
+ * guest code: the QEMU binary, the host CPU, and the guest machine and
+ * CPU configuration.
+ */
+static void tb_cache_compute_key(uint8_t *key)
+{
+    GChecksum *ck = g_checksum_new(G_CHECKSUM_SHA256);
+    g_autoptr(GPtrArray) props = g_ptr_array_new_with_free_func(g_free);
+    MachineState *ms = current_machine;
+    ObjectPropertyIterator iter;
+    ObjectProperty *prop;
+    gsize len = TB_CACHE_KEY_LEN;
+    struct stat st;
+    uint64_t val;
+    guint i;
+
+    tb_cache_key_add_str(ck, QEMU_FULL_VERSION);
+    tb_cache_key_add_str(ck, TARGET_NAME);
+    if (stat("/proc/self/exe", &st) == 0) {
+        tb_cache_key_add(ck, &st.st_dev, sizeof(st.st_dev));
+        tb_cache_key_add(ck, &st.st_ino, sizeof(st.st_ino));
+        tb_cache_key_add(ck, &st.st_size, sizeof(st.st_size));
+        tb_cache_key_add(ck, &st.st_mtime, sizeof(st.st_mtime));
+    }
+    val = tb_cache.image_end - tb_cache.image_start;
+    tb_cache_key_add(ck, &val, sizeof(val));
+
+#ifdef CONFIG_CPUID_H
+    {
+        /* The features used by the TCG backend */
+        unsigned a, b, c, d;
+
+        __cpuid(1, a, b, c, d);
+        tb_cache_key_add(ck, &c, sizeof(c));
+        tb_cache_key_add(ck, &d, sizeof(d));
+        __cpuid_count(7, 0, a, b, c, d);
+        tb_cache_key_add(ck, &b, sizeof(b));
+        tb_cache_key_add(ck, &c, sizeof(c));
+        __cpuid(0x80000001, a, b, c, d);
+        tb_cache_key_add(ck, &c, sizeof(c));
+        tb_cache_key_add(ck, &d, sizeof(d));
+    }
+#endif
+
+    tb_cache_key_add_str(ck, MACHINE_GET_CLASS(ms)->name);
+    tb_cache_key_add_str(ck, ms->cpu_type ?: "");
+    val = ms->ram_size;
+    tb_cache_key_add(ck, &val, sizeof(val));
+    tb_cache_key_add(ck, &ms->smp, sizeof(ms->smp));
+
+    if (first_cpu) {
+        object_property_iter_init(&iter, OBJECT(first_cpu));
+        while ((prop = object_property_iter_next(&iter))) {
+            char *value;
+
+            if (!prop->get) {
+                continue;
+            }
+            value = object_property_print(OBJECT(first_cpu), prop->name,
+                                          false, NULL);
+            if (value) {
+                g_ptr_array_add(props, g_strdup_printf("%s=%s", prop->name,
+                                                       value));
+                g_free(value);
+            }
+        }
+        g_ptr_array_sort(props, (GCompareFunc)g_strcmp0);
+    }
+    for (i = 0; i < props->len; i++) {
+        tb_cache_key_add_str(ck, g_ptr_array_index(props, i));
+    }
+
+    g_checksum_get_digest(ck, key, &len);
+    g_checksum_free(ck);
+}
+
+static void tb_cache_init_done(Notifier *notifier, void *data)
+{
+    tb_cache_compute_key(tb_cache.key);
+    tb_cache_load();
+    qemu_add_exit_notifier(&tb_cache.exit);
+}
+
+static int tb_cache_find_image(struct dl_phdr_info *info, size_t size,
+                               void *data)
+{
+    uintptr_t start = UINTPTR_MAX, end = 0;
+    int i;
+
+    /* The first object is the executable */
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+
+        if (ph->p_type == PT_LOAD) {
+            start = MIN(start, info->dlpi_addr + ph->p_vaddr);
+            end = MAX(end, info->dlpi_addr + ph->p_vaddr + ph->p_memsz);
+        }
+    }
+    tb_cache.image_start = start;
+    tb_cache.image_end = end;
+    tb_cache.image_bias = info->dlpi_addr;
+    return 1;
+}
+
+bool tb_cache_init(const char *path, Error **errp)
+{
+    dl_iterate_phdr(tb_cache_find_image, NULL);
+    if (tb_cache.image_start >= tb_cache.image_end) {
+        error_setg(errp, "tb-cache: cannot locate the QEMU executable");
+        return false;
+    }
+
+    tb_cache.path = g_strdup(path);
+    qemu_mutex_init(&tb_cache.lock);
+    /*
+     * The key of the loaded entries points into the file contents, the
+     * key of the recorded ones is the entry itself.
+     */
+    tb_cache.recorded = g_hash_table_new_full(tb_cache_entry_hash,
+                                              tb_cache_entry_equal,
+                                              g_free, NULL);
+    tb_cache.init_done.notify = tb_cache_init_done;
+    qemu_add_machine_init_done_notifier(&tb_cache.init_done);
+    tb_cache.exit.notify = tb_cache_save;
+
+    /* Copied by the contexts of the vCPU threads */
+    tcg_init_ctx.ext_refs_enabled = true;
+    tb_cache_enabled = true;
+    return true;
+}
+
+void tb_cache_dump_info(void)
+{
+    size_t lookups = qatomic_read(&tb_cache.lookups);
+    size_t hits = qatomic_read(&tb_cache.hits);
+
+    if (!tb_cache_enabled) {
+        return;
+    }
+    qemu_printf("\nTB cache:\n");
+    qemu_printf("TB cache file       %s\n", tb_cache.path);
+    qemu_printf("TB cache entries    %zu loaded, %zu recorded\n",
+                tb_cache.nb_loaded, qatomic_read(&tb_cache.nb_recorded));
+    qemu_printf("TB cache lookups    %zu (hits %zu %zu%%)\n", lookups, hits,
+                lookups ? hits * 100 / lookups : 0);
+    qemu_printf("TB cache stale      %zu\n", qatomic_read(&tb_cache.stale));
+    qemu_printf("TB cache rejected   %zu\n",
+                qatomic_read(&tb_cache.rejected));
+    qemu_printf("TB cache uncachable %zu\n",
+                qatomic_read(&tb_cache.uncacheable));
+}
+
+#else
+
+bool tb_cache_init(const char *path, Error **errp)
+{
+    error_setg(errp, "tb-cache is not supported on this host");
+    return false;
+}
+
+int tb_cache_restore(CPUState *cpu, TranslationBlock *tb,
+                     tb_page_addr_t phys_pc, int *search_size)
+{
+    return 0;
+}
+
+void tb_cache_record(CPUState *cpu, TranslationBlock *tb,
+                     tb_page_addr_t phys_pc, int search_size)
+{
+}
+
+void tb_cache_dump_info(void)
+{
+}
+
+#endif
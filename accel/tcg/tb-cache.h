@@ -0,0 +1,47 @@
+/*
+ * Persistent cache of translation blocks
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_CACHE_H
+#define ACCEL_TCG_TB_CACHE_H
+
+#include "exec/exec-all.h"
+
+#ifdef CONFIG_SOFTMMU
+extern bool tb_cache_enabled;
+
+bool tb_cache_init(const char *path, Error **errp);
+
+/*
+ * tb_cache_restore: fill @tb with the host code saved by a previous run
+ *
+ * Returns the size of the code, 0 if the TB must be translated, or -1
+ * if the code does not fit in the current region.  On success the size
+ * of the search data that follows the code is stored in @search_size.
+ */
+int tb_cache_restore(CPUState *cpu, TranslationBlock *tb,
+                     tb_page_addr_t phys_pc, int *search_size);
+
+/* Remember the code of @tb, which was just translated, for the next run */
+void tb_cache_record(CPUState *cpu, TranslationBlock *tb,
+                     tb_page_addr_t phys_pc, int search_size);
+
+void tb_cache_dump_info(void);
+#else
+#define tb_cache_enabled false
+
+static inline int tb_cache_restore(CPUState *cpu, TranslationBlock *tb,
+                                   tb_page_addr_t phys_pc, int *search_size)
+{
+    return 0;
+}
+
+static inline void tb_cache_record(CPUState *cpu, TranslationBlock *tb,
+                                   tb_page_addr_t phys_pc, int search_size)
+{
+}
+#endif
+
+#endif /* ACCEL_TCG_TB_CACHE_H */
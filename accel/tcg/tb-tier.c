@@ -0,0 +1,252 @@
+/*
+ * Tiered translation of TBs
+ *
+ * When enabled, the TBs found missing by the vCPU threads are translated
+ * without running the TCG optimizer and flagged CF_COLD.  Nothing chains
+ * to a cold TB, so each of its executions goes through the main loop,
+ * which counts them.  Once a cold TB has run tb_tier_threshold times it is
+ * queued to a background thread, which translates it again with full
+ * optimization and replaces it in the TB hash table; the vCPUs pick up the
+ * new TB on their next lookup and chain to it as usual.
+ *
+ * The hot TB can also be a trace, which the target translates across the
+ * direct jumps that stay within its first page.  The jumps that are not
+ * followed become side exits.
+ *
+ * In user mode all translation happens under mmap_lock, which the
+ * background thread holds while it replaces a TB: a vCPU that misses in
+ * the meantime finds the optimized TB when it links its own translation.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/units.h"
+#include "qemu/thread.h"
+#include "qemu/rcu.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
+#include "exec/tb-context.h"
+#include "tcg/tcg.h"
+#include "internal.h"
+#include "tb-tier.h"
+#include "trace.h"
+
+/* Do not retranslate when the code buffer is about to be flushed */
+#define TB_TIER_MIN_SPACE   (1 * MiB)
+
+/* Requests beyond this are dropped, and retried after more executions */
+#define TB_TIER_MAX_QUEUE   4096
+
+typedef struct TBTierRequest {
+    CPUState *cpu;
+    TranslationBlock *tb;
+    unsigned tb_flush_count;
+    QSIMPLEQ_ENTRY(TBTierRequest) next;
+} TBTierRequest;
+
+uint32_t tb_tier_threshold;
+bool tb_tier_trace;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;
+    QSIMPLEQ_HEAD(, TBTierRequest) queue;
+    unsigned int queued;
+    bool started;
+    bool stopping;
+    QemuThread thread;
+} tb_tier = {
+    .queue = QSIMPLEQ_HEAD_INITIALIZER(tb_tier.queue),
+};
+
+static void tb_tier_retranslate(TBTierRequest *req)
+{
+    TranslationBlock *tb = req->tb;
+    TranslationBlock *hot;
+    CPUState *cpu;
+    uint32_t cflags;
+    const int prot = PAGE_VALID | PAGE_EXEC;
+
+    mmap_lock();
+    /* A flush frees the TB, an invalidation makes it stale */
+    if (qatomic_read(&tb_ctx.tb_flush_count) != req->tb_flush_count ||
+        (tb_cflags(tb) & CF_INVALID)) {
+        goto out;
+    }
+
+    if (tcg_code_capacity() - tcg_code_size() < TB_TIER_MIN_SPACE) {
+        goto skip;
+    }
+
+    /*
+     * The guest may have unmapped or mprotected the code since it ran;
+     * the translator would fault on it, and there is no vCPU to deliver
+     * the signal to.
+     */
+    if ((page_get_flags(tb->pc) & prot) != prot ||
+        (page_get_flags(tb->pc + tb->size - 1) & prot) != prot) {
+        goto skip;
+    }
+
+    /* Translation reads the configuration of the CPU, if it still exists */
+    cpu_list_lock();
+    CPU_FOREACH(cpu) {
+        if (cpu == req->cpu) {
+            break;
+        }
+    }
+    if (cpu) {
+        cflags = tb_cflags(tb) & ~CF_COLD;
+        if (tb_tier_trace) {
+            cflags |= CF_TRACE;
+        }
+        tb_phys_invalidate(tb, -1);
+        hot = tb_gen_code(cpu, tb->pc, tb->cs_base, tb->flags, cflags);
+        trace_tb_tier_retranslate(tb->pc, tb->tc.size, hot->tc.size);
+    }
+    cpu_list_unlock();
+    if (cpu) {
+        goto out;
+    }
+
+ skip:
+    /*
+     * The TB is still cold and tb_tier_exec() only queues it when its
+     * count reaches the threshold; start counting again, as for a full
+     * queue, or it would stay unchained for good.
+     */
+    qatomic_set(&tb->exec_count, 0);
+ out:
+    mmap_unlock();
+}
+
+static void *tb_tier_thread(void *opaque)
+{
+    TBTierRequest *req;
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    qemu_mutex_lock(&tb_tier.lock);
+    while (!tb_tier.stopping) {
+        if (QSIMPLEQ_EMPTY(&tb_tier.queue)) {
+            qemu_cond_wait(&tb_tier.cond, &tb_tier.lock);
+            continue;
+        }
+        req = QSIMPLEQ_FIRST(&tb_tier.queue);
+        QSIMPLEQ_REMOVE_HEAD(&tb_tier.queue, next);
+        tb_tier.queued--;
+        qemu_mutex_unlock(&tb_tier.lock);
+
+        tb_tier_retranslate(req);
+        g_free(req);
+
+        qemu_mutex_lock(&tb_tier.lock);
+    }
+    qemu_mutex_unlock(&tb_tier.lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+void tb_tier_queue(CPUState *cpu, TranslationBlock *tb)
+{
+    TBTierRequest *req;
+
+    qemu_mutex_lock(&tb_tier.lock);
+    if (tb_tier.stopping) {
+        qemu_mutex_unlock(&tb_tier.lock);
+        return;
+    }
+    if (tb_tier.queued == TB_TIER_MAX_QUEUE) {
+        qemu_mutex_unlock(&tb_tier.lock);
+        qatomic_set(&tb->exec_count, 0);
+        return;
+    }
+
+    req = g_new(TBTierRequest, 1);
+    req->cpu = cpu;
+    req->tb = tb;
+    req->tb_flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+    QSIMPLEQ_INSERT_TAIL(&tb_tier.queue, req, next);
+    tb_tier.queued++;
+    trace_tb_tier_queue(tb->pc, tb_tier.queued);
+
+    if (!tb_tier.started) {
+        qemu_thread_create(&tb_tier.thread, "tcg-tier", tb_tier_thread,
+                           NULL, QEMU_THREAD_JOINABLE);
+        tb_tier.started = true;
+    }
+    qemu_cond_signal(&tb_tier.cond);
+    qemu_mutex_unlock(&tb_tier.lock);
+}
+
+/*
+ * Stop the background thread before the process exits.  A retranslation
+ * in progress completes first, the queued ones are dropped.
+ */
+void tb_tier_shutdown(void)
+{
+    TBTierRequest *req, *tmp;
+
+    if (!tb_tier_threshold) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_tier.lock);
+    if (!tb_tier.started || tb_tier.stopping) {
+        qemu_mutex_unlock(&tb_tier.lock);
+        return;
+    }
+    tb_tier.stopping = true;
+    qemu_cond_signal(&tb_tier.cond);
+    qemu_mutex_unlock(&tb_tier.lock);
+
+    qemu_thread_join(&tb_tier.thread);
+
+    QSIMPLEQ_FOREACH_SAFE(req, &tb_tier.queue, next, tmp) {
+        g_free(req);
+    }
+    QSIMPLEQ_INIT(&tb_tier.queue);
+    tb_tier.queued = 0;
+}
+
+/*
+ * The background thread does not survive fork(); keep it from holding
+ * the lock across it, and let the child start its own.
+ */
+void tb_tier_fork_start(void)
+{
+    if (tb_tier_threshold) {
+        qemu_mutex_lock(&tb_tier.lock);
+    }
+}
+
+void tb_tier_fork_end(int child)
+{
+    TBTierRequest *req, *tmp;
+
+    if (!tb_tier_threshold) {
+        return;
+    }
+    if (child) {
+        QSIMPLEQ_FOREACH_SAFE(req, &tb_tier.queue, next, tmp) {
+            g_free(req);
+        }
+        QSIMPLEQ_INIT(&tb_tier.queue);
+        tb_tier.queued = 0;
+        tb_tier.started = false;
+        qemu_mutex_init(&tb_tier.lock);
+        qemu_cond_init(&tb_tier.cond);
+    } else {
+        qemu_mutex_unlock(&tb_tier.lock);
+    }
+}
+
+static void __attribute__((constructor)) tb_tier_init(void)
+{
+    qemu_mutex_init(&tb_tier.lock);
+    qemu_cond_init(&tb_tier.cond);
+}
@@ -0,0 +1,38 @@
+/*
+ * Tiered translation of TBs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_TIER_H
+#define ACCEL_TCG_TB_TIER_H
+
+#include "exec/exec-all.h"
+
+#ifdef CONFIG_USER_ONLY
+/* Executions after which a CF_COLD TB is retranslated, 0 if disabled */
+extern uint32_t tb_tier_threshold;
+/* Retranslate hot TBs with CF_TRACE */
+extern bool tb_tier_trace;
+
+void tb_tier_queue(CPUState *cpu, TranslationBlock *tb);
+
+/*
+ * CF_COLD TBs are not chained to, so that each of their executions goes
+ * through the main loop and is counted here.
+ */
+static inline void tb_tier_exec(CPUState *cpu, TranslationBlock *tb)
+{
+    if (qatomic_fetch_inc(&tb->exec_count) + 1 == tb_tier_threshold) {
+        tb_tier_queue(cpu, tb);
+    }
+}
+#else
+#define tb_tier_threshold 0
+
+static inline void tb_tier_exec(CPUState *cpu, TranslationBlock *tb)
+{
+}
+#endif
+
+#endif /* ACCEL_TCG_TB_TIER_H */
@@ -32,6 +32,11 @@
 #include "qemu/error-report.h"
 #include "qemu/accel.h"
 #include "qapi/qapi-builtin-visit.h"
+#ifndef CONFIG_USER_ONLY
+#include "tb-cache.h"
+#else
+#include "tb-tier.h"
+#endif
 
 struct TCGState {
     AccelState parent_obj;
@@ -39,6 +44,9 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    char *tb_cache;
+    uint32_t tier_threshold;
+    bool tier_trace;
 };
 typedef struct TCGState TCGState;
 
@@ -119,7 +127,18 @@ static int tcg_init(MachineState *ms)
      * generation needs to be delayed so that GUEST_BASE is already set.
      */
 #ifndef CONFIG_USER_ONLY
+    if (s->tb_cache) {
+        Error *local_err = NULL;
+
+        if (!tb_cache_init(s->tb_cache, &local_err)) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+    }
     tcg_region_init();
+#else
+    tb_tier_threshold = s->tier_threshold;
+    tb_tier_trace = s->tier_trace;
 #endif /* !CONFIG_USER_ONLY */
 
     return 0;
@@ -196,6 +215,60 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+#ifndef CONFIG_USER_ONLY
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+#else
+static void tcg_get_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->tier_threshold, errp);
+}
+
+static void tcg_set_tier_threshold(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->tier_threshold = value;
+}
+
+static bool tcg_get_tier_trace(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->tier_trace;
+}
+
+static void tcg_set_tier_trace(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->tier_trace = value;
+}
+#endif
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -217,6 +290,25 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+#ifndef CONFIG_USER_ONLY
+    object_class_property_add_str(oc, "tb-cache",
+        tcg_get_tb_cache, tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File to save translated code to and load it from across runs");
+#else
+    object_class_property_add(oc, "tier-threshold", "uint32",
+        tcg_get_tier_threshold, tcg_set_tier_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "tier-threshold",
+        "Executions after which a TB is optimized in the background "
+        "(0 translates every TB optimized)");
+
+    object_class_property_add_bool(oc, "tier-trace",
+        tcg_get_tier_trace, tcg_set_tier_trace);
+    object_class_property_set_description(oc, "tier-trace",
+        "Optimize hot code across the direct jumps within a page");
+#endif
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -153,7 +153,8 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     uint32_t flags;
 
     tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, curr_cflags());
-    if (tb == NULL) {
+    /* Cold TBs are entered from the main loop, which counts executions */
+    if (tb == NULL || (tb_cflags(tb) & CF_COLD)) {
         return tcg_code_gen_epilogue;
     }
     qemu_log_mask_and_addr(CPU_LOG_EXEC, pc,
@@ -51,6 +51,7 @@
 #include "exec/tb-hash.h"
 #include "exec/translate-all.h"
 #include "qemu/bitmap.h"
+#include "qemu/rcu.h"
 #include "qemu/error-report.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
@@ -61,6 +62,7 @@
 #include "sysemu/tcg.h"
 #include "qapi/error.h"
 #include "internal.h"
+#include "tb-cache.h"
 
 /* #define DEBUG_TB_INVALIDATE */
 /* #define DEBUG_TB_FLUSH */
@@ -104,13 +106,25 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+/*
+ * Bytes of a page covered by TBs.  Bits are only set while the page lock
+ * is held, and a bitmap is replaced rather than cleared in place; writes
+ * to the page read it under RCU without taking any lock.  Bits of the
+ * TBs removed from the page stay set until it is rebuilt, so a clear bit
+ * always means that no TB covers the byte.
+ */
+typedef struct PageBitmap {
+    struct rcu_head rcu;
+    unsigned long bits[];
+} PageBitmap;
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
 #ifdef CONFIG_SOFTMMU
     /* in order to optimize self modifying code, we count the number
        of lookups we do to a given page to use a bitmap */
-    unsigned long *code_bitmap;
+    PageBitmap *code_bitmap;
     unsigned int code_write_count;
 #else
     unsigned long flags;
@@ -1357,8 +1371,12 @@ static inline void invalidate_page_bitmap(PageDesc *p)
 {
     assert_page_locked(p);
 #ifdef CONFIG_SOFTMMU
-    g_free(p->code_bitmap);
-    p->code_bitmap = NULL;
+    if (p->code_bitmap) {
+        PageBitmap *old = p->code_bitmap;
+
+        qatomic_rcu_set(&p->code_bitmap, NULL);
+        g_free_rcu(old, rcu);
+    }
     p->code_write_count = 0;
 #endif
 }
@@ -1463,6 +1481,101 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    size_t *nb_tbs = data;
+
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+    (*nb_tbs)++;
+    return false;
+}
+
+/* evict the translation blocks of the least used code regions */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_evict_count)
+{
+    unsigned int *hits;
+    size_t n_regions, nb_regions = 0, nb_tbs = 0;
+    CPUState *other;
+    int i;
+
+    mmap_lock();
+    if (tb_ctx.tb_evict_count != tb_evict_count.host_int) {
+        mmap_unlock();
+        return;
+    }
+
+    /*
+     * What the vCPUs ran last is still in their jump caches: count it
+     * per region, so that the regions with the hot code are kept.
+     */
+    n_regions = tcg_nb_regions();
+    hits = g_new0(unsigned int, n_regions);
+    CPU_FOREACH(other) {
+        for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+            TranslationBlock *tb = qatomic_read(&other->tb_jmp_cache[i]);
+
+            if (tb) {
+                hits[tcg_region_index(tb->tc.ptr)]++;
+            }
+        }
+    }
+    nb_regions = tcg_region_evict(hits, tb_evict_iter, &nb_tbs);
+    g_free(hits);
+
+    if (nb_regions) {
+        /*
+         * tb_phys_invalidate() only drops the TBs it invalidates from the
+         * jump caches; the evicted TBs that were already invalid go now.
+         */
+        CPU_FOREACH(other) {
+            for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+                TranslationBlock *tb = qatomic_read(&other->tb_jmp_cache[i]);
+
+                if (tb && (tb_cflags(tb) & CF_INVALID)) {
+                    qatomic_set(&other->tb_jmp_cache[i], NULL);
+                }
+            }
+        }
+        tb_ctx.tb_evict_regions += nb_regions;
+        tb_ctx.tb_evict_tbs += nb_tbs;
+    }
+    qatomic_mb_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+    mmap_unlock();
+
+    if (nb_regions) {
+        qemu_plugin_flush_cb();
+    } else {
+        /* every region is still being filled, start over */
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(
+                             qatomic_mb_read(&tb_ctx.tb_flush_count)));
+    }
+}
+
+/*
+ * Make room in the code buffer when it is full.  With a single region,
+ * as in user mode, there is nothing to evict and the buffer is flushed.
+ */
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_evict_count;
+
+    if (tcg_nb_regions() == 1) {
+        tb_flush(cpu);
+        return;
+    }
+
+    tb_evict_count = qatomic_mb_read(&tb_ctx.tb_evict_count);
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_evict_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_evict_count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1640,13 +1753,12 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     /* remove the TB from the page list */
     if (rm_from_page_list) {
+        /* The code bitmaps keep the TB's bits until they are rebuilt */
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
         tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
         if (tb->page_addr[1] != -1) {
             p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
             tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
         }
     }
 
@@ -1692,30 +1804,59 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
-/* call with @p->lock held */
+/* Set the bits of the part of @tb that is in its page @n */
+static void page_bitmap_add_tb(PageBitmap *bm, TranslationBlock *tb,
+                               unsigned int n)
+{
+    int tb_start, tb_end;
+
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        tb_end = tb_start + tb->size;
+        if (tb_end > TARGET_PAGE_SIZE) {
+            tb_end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        tb_start = 0;
+        tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+    bitmap_set_atomic(bm->bits, tb_start, tb_end - tb_start);
+}
+
+/* Whether any TB of @bm covers [@start, @end[, which is within one page */
+static bool page_bitmap_hit(PageBitmap *bm, tb_page_addr_t start,
+                            tb_page_addr_t end)
+{
+    unsigned int nr = start & ~TARGET_PAGE_MASK;
+    unsigned int last = nr + (end - start);
+
+    return find_next_bit(bm->bits, last, nr) < last;
+}
+
+/*
+ * Build the bitmap of the TBs in the page, replacing the current one.
+ * call with @p->lock held
+ */
 static void build_page_bitmap(PageDesc *p)
 {
-    int n, tb_start, tb_end;
+    PageBitmap *bm, *old = p->code_bitmap;
     TranslationBlock *tb;
+    int n;
 
     assert_page_locked(p);
-    p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    bm = g_malloc0(sizeof(PageBitmap) +
+                   BITS_TO_LONGS(TARGET_PAGE_SIZE) * sizeof(unsigned long));
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+        page_bitmap_add_tb(bm, tb, n);
+    }
+
+    qatomic_rcu_set(&p->code_bitmap, bm);
+    if (old) {
+        g_free_rcu(old, rcu);
     }
 }
 #endif
@@ -1740,7 +1881,14 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     page_already_protected = p->first_tb != (uintptr_t)NULL;
 #endif
     p->first_tb = (uintptr_t)tb | n;
+#ifdef CONFIG_SOFTMMU
+    /* Before the TB can run, writes to the page must see its bits */
+    if (p->code_bitmap) {
+        page_bitmap_add_tb(p->code_bitmap, tb, n);
+    }
+#else
     invalidate_page_bitmap(p);
+#endif
 
 #if defined(CONFIG_USER_ONLY)
     if (p->flags & PAGE_WRITE) {
@@ -1836,10 +1984,8 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
         /* remove TB from the page(s) if we couldn't insert it */
         if (unlikely(existing_tb)) {
             tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
             if (p2) {
                 tb_page_remove(p2, tb);
-                invalidate_page_bitmap(p2);
             }
             tb = existing_tb;
         }
@@ -1869,6 +2015,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+    bool from_tb_cache = false;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1902,8 +2049,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1918,7 +2065,19 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cflags = cflags;
     tb->orig_tb = NULL;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
     tcg_ctx->tb_cflags = cflags;
+
+    if (tb_cache_enabled && phys_pc != -1) {
+        gen_code_size = tb_cache_restore(cpu, tb, phys_pc, &search_size);
+        if (unlikely(gen_code_size < 0)) {
+            goto buffer_overflow;
+        }
+        if (gen_code_size > 0) {
+            from_tb_cache = true;
+            goto tb_cached;
+        }
+    }
  tb_overflow:
 
 #ifdef CONFIG_PROFILER
@@ -2076,6 +2235,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
 #endif
 
+ tb_cached:
     qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN));
@@ -2102,6 +2262,15 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
+    /*
+     * Before the TB is linked, so that its jumps are still unpatched.
+     * Only TBs within one page are cached: phys_page2 is also -1 when
+     * the second page is not RAM.
+     */
+    if (tb_cache_enabled && !from_tb_cache &&
+        (pc & TARGET_PAGE_MASK) == virt_page2) {
+        tb_cache_record(cpu, tb, phys_pc, search_size);
+    }
     /*
      * No explicit memory barrier is required -- tb_link_page() makes the
      * TB visible in a consistent state.
@@ -2134,6 +2303,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
     TranslationBlock *tb;
     tb_page_addr_t tb_start, tb_end;
     int n;
+    bool invalidated = false;
 #ifdef TARGET_HAS_PRECISE_SMC
     CPUState *cpu = current_cpu;
     CPUArchState *env = NULL;
@@ -2191,6 +2361,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
             }
 #endif /* TARGET_HAS_PRECISE_SMC */
             tb_phys_invalidate__locked(tb);
+            invalidated = true;
         }
     }
 #if !defined(CONFIG_USER_ONLY)
@@ -2198,6 +2369,15 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
     if (!p->first_tb) {
         invalidate_page_bitmap(p);
         tlb_unprotect_code(start);
+    } else if (p->code_bitmap &&
+               (invalidated ||
+                page_bitmap_hit(p->code_bitmap, start, end))) {
+        /*
+         * Drop the bits of the invalidated TBs, or the stale bits of TBs
+         * removed through their other page that made this write look
+         * like it hit code.
+         */
+        build_page_bitmap(p);
     }
 #endif
 #ifdef TARGET_HAS_PRECISE_SMC
@@ -2301,7 +2481,7 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
         unsigned long b;
 
         nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+        b = p->code_bitmap->bits[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
         if (b & ((1 << len) - 1)) {
             goto do_invalidate;
         }
@@ -2311,6 +2491,40 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
                                               retaddr);
     }
 }
+
+/*
+ * Return true if the code bitmap of the page shows that no TB covers
+ * [@start, @start + @len[, in which case a write there needs neither
+ * tb_invalidate_phys_page_fast() nor the page locks.  Return false if
+ * that cannot be told without taking the locks.
+ *
+ * Nothing is locked: a TB is added to the bitmap before it is added to
+ * the hash table, so a write that races with its translation is as
+ * unordered as it would be if it took the locks.
+ */
+bool tb_invalidate_phys_page_unneeded(tb_page_addr_t start, int len)
+{
+    unsigned int nr = start & ~TARGET_PAGE_MASK;
+    PageBitmap *bm;
+    PageDesc *p;
+    bool ret = false;
+
+    if (nr + len > TARGET_PAGE_SIZE) {
+        return false;
+    }
+    p = page_find(start >> TARGET_PAGE_BITS);
+    if (!p) {
+        return true;
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        bm = qatomic_rcu_read(&p->code_bitmap);
+        if (bm) {
+            ret = find_next_bit(bm->bits, nr + len, nr) >= nr + len;
+        }
+    }
+    return ret;
+}
 #else
 /* Called with mmap_lock held. If pc is not 0 then it indicates the
  * host PC of the faulting store instruction that caused this invalidate.
@@ -2554,6 +2768,7 @@ void dump_exec_info(void)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t large_fill, large_flush;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2588,6 +2803,9 @@ void dump_exec_info(void)
     qemu_printf("\nStatistics:\n");
     qemu_printf("TB flush count      %u\n",
                 qatomic_read(&tb_ctx.tb_flush_count));
+    qemu_printf("TB evict count      %u (%zu regions, %zu TBs)\n",
+                qatomic_read(&tb_ctx.tb_evict_count),
+                tb_ctx.tb_evict_regions, tb_ctx.tb_evict_tbs);
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
 
@@ -2595,6 +2813,10 @@ void dump_exec_info(void)
     qemu_printf("TLB full flushes    %zu\n", flush_full);
     qemu_printf("TLB partial flushes %zu\n", flush_part);
     qemu_printf("TLB elided flushes  %zu\n", flush_elide);
+    tlb_large_page_counts(&large_fill, &large_flush);
+    qemu_printf("TLB large page fills   %zu\n", large_fill);
+    qemu_printf("TLB large page flushes %zu\n", large_flush);
+    tb_cache_dump_info();
     tcg_dump_info();
 }
 
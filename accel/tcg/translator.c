@@ -32,6 +32,27 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
+/* Bound the unrolling of loops that fit in a single page */
+#define TRANSLATOR_MAX_TRACE_JUMPS  16
+
+bool translator_trace_jump(DisasContextBase *db, target_ulong insn_end,
+                           target_ulong dest)
+{
+    if (!(tb_cflags(db->tb) & CF_TRACE)
+        || db->singlestep_enabled
+        || db->num_jumps >= TRANSLATOR_MAX_TRACE_JUMPS
+        || db->num_insns >= db->max_insns
+        || tcg_op_buf_full()
+        || dest < db->pc_first
+        || (dest & TARGET_PAGE_MASK) != (db->pc_first & TARGET_PAGE_MASK)) {
+        return false;
+    }
+
+    db->pc_max = MAX(db->pc_max, insn_end);
+    db->num_jumps++;
+    return true;
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
@@ -42,9 +63,11 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->tb = tb;
     db->pc_first = tb->pc;
     db->pc_next = db->pc_first;
+    db->pc_max = db->pc_first;
     db->is_jmp = DISAS_NEXT;
     db->num_insns = 0;
     db->max_insns = max_insns;
+    db->num_jumps = 0;
     db->singlestep_enabled = cpu->singlestep_enabled;
 
     ops->init_disas_context(db, cpu);
@@ -132,8 +155,11 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
         plugin_gen_tb_end(cpu);
     }
 
-    /* The disas_log hook may use these values rather than recompute.  */
-    tb->size = db->pc_next - db->pc_first;
+    /*
+     * The disas_log hook may use these values rather than recompute.
+     * A trace that followed a jump backwards ends before pc_max.
+     */
+    tb->size = MAX(db->pc_next, db->pc_max) - db->pc_first;
     tb->icount = db->num_insns;
 
 #ifdef DEBUG_DISAS
@@ -0,0 +1,65 @@
+/*
+ * BlockBackend RAM Registrar
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/block-ram-registrar.h"
+#include "exec/cpu-common.h"
+
+static void ram_block_added(RAMBlockNotifier *n, void *host, size_t size)
+{
+    BlockRAMRegistrar *r = container_of(n, BlockRAMRegistrar, notifier);
+
+    blk_register_buf(r->blk, host, size);
+}
+
+static void ram_block_removed(RAMBlockNotifier *n, void *host, size_t size)
+{
+    BlockRAMRegistrar *r = container_of(n, BlockRAMRegistrar, notifier);
+
+    if (host) {
+        blk_unregister_buf(r->blk, host);
+    }
+}
+
+static int ram_block_register(RAMBlock *rb, void *opaque)
+{
+    BlockRAMRegistrar *r = opaque;
+    void *host = qemu_ram_get_host_addr(rb);
+
+    if (host) {
+        blk_register_buf(r->blk, host, qemu_ram_get_used_length(rb));
+    }
+    return 0;
+}
+
+static int ram_block_unregister(RAMBlock *rb, void *opaque)
+{
+    BlockRAMRegistrar *r = opaque;
+    void *host = qemu_ram_get_host_addr(rb);
+
+    if (host) {
+        blk_unregister_buf(r->blk, host);
+    }
+    return 0;
+}
+
+void blk_ram_registrar_init(BlockRAMRegistrar *r, BlockBackend *blk)
+{
+    r->blk = blk;
+    r->notifier = (RAMBlockNotifier) {
+        .ram_block_added = ram_block_added,
+        .ram_block_removed = ram_block_removed,
+    };
+    ram_block_notifier_add(&r->notifier);
+    qemu_ram_foreach_block(ram_block_register, r);
+}
+
+void blk_ram_registrar_destroy(BlockRAMRegistrar *r)
+{
+    ram_block_notifier_remove(&r->notifier);
+    qemu_ram_foreach_block(ram_block_unregister, r);
+}
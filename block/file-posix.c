@@ -172,8 +172,16 @@ typedef struct BDRVRawState {
     } stats;
 
     PRManager *pr_mgr;
+
+    /* Memory passed to raw_register_buf(), as RawRegisteredBuf */
+    GArray *registered_bufs;
 } BDRVRawState;
 
+typedef struct RawRegisteredBuf {
+    void *host;
+    size_t size;
+} RawRegisteredBuf;
+
 typedef struct BDRVRawReopenState {
     int fd;
     int open_flags;
@@ -1137,6 +1145,22 @@ out:
     return ret;
 }
 
+/*
+ * io_uring keeps a reference to the registered file, and a new file may
+ * get the same descriptor: drop the registration before closing s->fd.
+ */
+static void raw_unregister_fd(BlockDriverState *bs)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    BDRVRawState *s = bs->opaque;
+
+    if (s->use_linux_io_uring && s->fd >= 0) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        luring_unregister_fd(aio, s->fd);
+    }
+#endif
+}
+
 static void raw_reopen_commit(BDRVReopenState *state)
 {
     BDRVRawReopenState *rs = state->opaque;
@@ -1146,6 +1170,7 @@ static void raw_reopen_commit(BDRVReopenState *state)
     s->check_cache_dropped = rs->check_cache_dropped;
     s->open_flags = rs->open_flags;
 
+    raw_unregister_fd(state->bs);
     qemu_close(s->fd);
     s->fd = rs->fd;
 
@@ -2009,10 +2034,18 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, uint64_t offset,
     if (s->needs_alignment && !bdrv_qiov_is_aligned(bs, qiov)) {
         type |= QEMU_AIO_MISALIGNED;
 #ifdef CONFIG_LINUX_IO_URING
-    } else if (s->use_linux_io_uring) {
+    } else if (s->use_linux_io_uring &&
+               luring_supports(aio_get_linux_io_uring(bdrv_get_aio_context(bs)),
+                               type, s->open_flags)) {
         LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        int ret;
+
         assert(qiov->size == bytes);
-        return luring_co_submit(bs, aio, s->fd, offset, qiov, type);
+        ret = luring_co_submit(bs, aio, s->fd, offset, qiov, type);
+        /* Polled completions are not supported by every device */
+        if (ret != -EOPNOTSUPP) {
+            return ret;
+        }
 #endif
 #ifdef CONFIG_LINUX_AIO
     } else if (s->use_linux_aio) {
@@ -2107,12 +2140,32 @@ static int raw_co_flush_to_disk(BlockDriverState *bs)
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
         LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
-        return luring_co_submit(bs, aio, s->fd, 0, NULL, QEMU_AIO_FLUSH);
+        if (luring_supports(aio, QEMU_AIO_FLUSH, s->open_flags)) {
+            return luring_co_submit(bs, aio, s->fd, 0, NULL, QEMU_AIO_FLUSH);
+        }
     }
 #endif
     return raw_thread_pool_submit(bs, handle_aiocb_flush, &acb);
 }
 
+static void raw_aio_detach_aio_context(BlockDriverState *bs)
+{
+    BDRVRawState __attribute__((unused)) *s = bs->opaque;
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        unsigned int i;
+
+        raw_unregister_fd(bs);
+        for (i = 0; s->registered_bufs && i < s->registered_bufs->len; i++) {
+            luring_unregister_buf(aio, g_array_index(s->registered_bufs,
+                                                     RawRegisteredBuf,
+                                                     i).host);
+        }
+    }
+#endif
+}
+
 static void raw_aio_attach_aio_context(BlockDriverState *bs,
                                        AioContext *new_context)
 {
@@ -2136,14 +2189,81 @@ static void raw_aio_attach_aio_context(BlockDriverState *bs,
             s->use_linux_io_uring = false;
         }
     }
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(new_context);
+        unsigned int i;
+
+        for (i = 0; s->registered_bufs && i < s->registered_bufs->len; i++) {
+            RawRegisteredBuf *buf = &g_array_index(s->registered_bufs,
+                                                   RawRegisteredBuf, i);
+            luring_register_buf(aio, buf->host, buf->size);
+        }
+    }
+#endif
+}
+
+static void raw_register_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+    RawRegisteredBuf buf = {
+        .host = host,
+        .size = size,
+    };
+
+    if (!s->registered_bufs) {
+        s->registered_bufs = g_array_new(false, false,
+                                         sizeof(RawRegisteredBuf));
+    }
+    g_array_append_val(s->registered_bufs, buf);
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        AioContext *ctx = bdrv_get_aio_context(bs);
+
+        aio_context_acquire(ctx);
+        luring_register_buf(aio_get_linux_io_uring(ctx), host, size);
+        aio_context_release(ctx);
+    }
 #endif
 }
 
+static void raw_unregister_buf(BlockDriverState *bs, void *host)
+{
+    BDRVRawState *s = bs->opaque;
+    unsigned int i;
+
+    for (i = 0; s->registered_bufs && i < s->registered_bufs->len; i++) {
+        if (g_array_index(s->registered_bufs,
+                          RawRegisteredBuf, i).host != host) {
+            continue;
+        }
+        g_array_remove_index_fast(s->registered_bufs, i);
+
+#ifdef CONFIG_LINUX_IO_URING
+        if (s->use_linux_io_uring) {
+            AioContext *ctx = bdrv_get_aio_context(bs);
+
+            aio_context_acquire(ctx);
+            luring_unregister_buf(aio_get_linux_io_uring(ctx), host);
+            aio_context_release(ctx);
+        }
+#endif
+        return;
+    }
+}
+
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
 
+    while (s->registered_bufs && s->registered_bufs->len) {
+        raw_unregister_buf(bs, g_array_index(s->registered_bufs,
+                                             RawRegisteredBuf, 0).host);
+    }
+    g_clear_pointer(&s->registered_bufs, g_array_unref);
+
     if (s->fd >= 0) {
+        raw_unregister_fd(bs);
         qemu_close(s->fd);
         s->fd = -1;
     }
@@ -3015,11 +3135,22 @@ static int raw_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
 static BlockStatsSpecificFile get_blockstats_specific_file(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
-    return (BlockStatsSpecificFile) {
+    BlockStatsSpecificFile stats = {
         .discard_nb_ok = s->stats.discard_nb_ok,
         .discard_nb_failed = s->stats.discard_nb_failed,
         .discard_bytes_ok = s->stats.discard_bytes_ok,
     };
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+
+        stats.has_io_uring = true;
+        stats.io_uring = g_new(BlockStatsSpecificIoUring, 1);
+        luring_get_stats(aio, stats.io_uring);
+    }
+#endif
+    return stats;
 }
 
 static BlockStatsSpecific *raw_get_specific_stats(BlockDriverState *bs)
@@ -3146,6 +3277,7 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+        raw_unregister_fd(bs);
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -3248,6 +3380,9 @@ BlockDriver bdrv_file = {
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
 
     .bdrv_co_truncate = raw_co_truncate,
     .bdrv_getlength = raw_getlength,
@@ -3622,6 +3757,9 @@ static BlockDriver bdrv_host_device = {
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
 
     .bdrv_co_truncate       = raw_co_truncate,
     .bdrv_getlength	= raw_getlength,
@@ -3746,6 +3884,9 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
 
     .bdrv_co_truncate    = raw_co_truncate,
     .bdrv_getlength      = raw_getlength,
@@ -3876,6 +4017,9 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
 
     .bdrv_co_truncate    = raw_co_truncate,
     .bdrv_getlength      = raw_getlength,
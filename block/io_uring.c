@@ -10,18 +10,27 @@
  */
 #include "qemu/osdep.h"
 #include <liburing.h>
+#include <sys/syscall.h>
 #include "qemu-common.h"
+#include "qemu/units.h"
 #include "block/aio.h"
 #include "qemu/queue.h"
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qapi/error.h"
+#include "exec/memory.h"
 #include "trace.h"
 
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Size of the registered file table */
+#define MAX_FIXED_FILES 64
+
+/* The kernel does not accept larger fixed buffers */
+#define FIXED_BUF_MAX_SIZE (1 * GiB)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -30,6 +39,10 @@ typedef struct LuringAIOCB {
     bool is_read;
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
+    /* For requests submitted to the AioContext's own io_uring */
+    LuringState *s;
+    AioUringRequest uring_req;
+
     /*
      * Buffered reads may require resubmission, see
      * luring_resubmit_short_read().
@@ -46,26 +59,97 @@ typedef struct LuringQueue {
     QSIMPLEQ_HEAD(, LuringAIOCB) submit_queue;
 } LuringQueue;
 
+/*
+ * A memory area registered with luring_register_buf().  It is split into
+ * FIXED_BUF_MAX_SIZE chunks, which occupy the fixed buffer table from
+ * @index on.
+ */
+typedef struct LuringFixedBuf {
+    void *host;
+    size_t size;
+    unsigned int refcnt;
+    unsigned int index;
+} LuringFixedBuf;
+
 typedef struct LuringState {
     AioContext *aio_context;
 
     struct io_uring ring;
 
+    /*
+     * Registered files save the kernel a file table lookup and reference
+     * per request.  Free slots hold -1.  If the kernel cannot register
+     * files, nr_fixed_files is 0.
+     */
+    int fixed_files[MAX_FIXED_FILES];
+    unsigned int nr_fixed_files;
+
+    /*
+     * Fixed buffers are pinned once instead of for each request.  They
+     * can only be used if the kernel accepted all of them.
+     */
+    GArray *fixed_bufs;
+    bool fixed_bufs_registered;
+
+    /*
+     * Pinned guest RAM must not be discarded, or the guest and the ring
+     * would see different pages; set while fixed buffers are registered.
+     */
+    bool discard_disabled;
+
     /* io queue for submit at batch.  Protected by AioContext lock. */
     LuringQueue io_q;
 
     /* I/O completion processing.  Only runs in I/O thread.  */
     QEMUBH *completion_bh;
+
+    /* IORING_SETUP_SQPOLL and IORING_SETUP_IOPOLL */
+    bool sqpoll;
+    bool iopoll;
+
+    /* Statistics, see luring_get_stats() */
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t syscalls;
 } LuringState;
 
+static void luring_uring_request_cb(AioUringRequest *req);
+
+/*
+ * Put @luringcb on the io_uring of the AioContext, in @sqe from
+ * aio_uring_get_sqe().  These requests are not counted in io_q, their
+ * completion runs luring_uring_request_cb().
+ */
+static void luring_submit_shared(LuringState *s, LuringAIOCB *luringcb,
+                                 struct io_uring_sqe *sqe)
+{
+    *sqe = luringcb->sqeq;
+    luringcb->s = s;
+    luringcb->uring_req.cb = luring_uring_request_cb;
+    aio_uring_sqe_set_request(sqe, &luringcb->uring_req);
+    s->submitted++;
+}
+
 /**
  * luring_resubmit:
  *
  * Resubmit a request by appending it to submit_queue.  The caller must ensure
  * that ioq_submit() is called later so that submit_queue requests are started.
+ *
+ * A request that went through the AioContext's io_uring goes there again
+ * if it still can, so that its completion is accounted the same way.
  */
 static void luring_resubmit(LuringState *s, LuringAIOCB *luringcb)
 {
+    if (luringcb->s) {
+        struct io_uring_sqe *sqe = aio_uring_get_sqe(s->aio_context);
+
+        if (sqe) {
+            luring_submit_shared(s, luringcb, sqe);
+            return;
+        }
+        luringcb->s = NULL;
+    }
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
     s->io_q.in_queue++;
 }
@@ -103,6 +187,10 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
                       remaining);
 
     /* Update sqe */
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->sqeq.opcode = IORING_OP_READV;
+        luringcb->sqeq.buf_index = 0;
+    }
     luringcb->sqeq.off = nread;
     luringcb->sqeq.addr = (__u64)(uintptr_t)luringcb->resubmit_qiov.iov;
     luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
@@ -110,6 +198,77 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     luring_resubmit(s, luringcb);
 }
 
+/*
+ * With IOPOLL, completions are only posted when somebody polls the device.
+ * The SQPOLL thread does that if there is one, otherwise the event loop
+ * must, and the ring file descriptor never becomes readable.
+ */
+static bool luring_needs_reap(LuringState *s)
+{
+    return s->iopoll && !s->sqpoll && s->io_q.in_flight;
+}
+
+static void luring_reap(LuringState *s)
+{
+    if (luring_needs_reap(s)) {
+        syscall(__NR_io_uring_enter, s->ring.ring_fd, 0, 0,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+        s->syscalls++;
+    }
+}
+
+/*
+ * Finish @luringcb, whose request returned @ret, unless it has to be
+ * resubmitted.
+ */
+static void luring_complete(LuringState *s, LuringAIOCB *luringcb, int ret)
+{
+    int total_bytes;
+
+    /* total_read is non-zero only for resubmitted read requests */
+    total_bytes = ret + luringcb->total_read;
+
+    if (ret < 0) {
+        if (ret == -EINTR) {
+            luring_resubmit(s, luringcb);
+            return;
+        }
+    } else if (!luringcb->qiov) {
+        goto end;
+    } else if (total_bytes == luringcb->qiov->size) {
+        ret = 0;
+    /* Only read/write */
+    } else {
+        /* Short Read/Write */
+        if (luringcb->is_read) {
+            if (ret > 0) {
+                luring_resubmit_short_read(s, luringcb, ret);
+                return;
+            } else {
+                /* Pad with zeroes */
+                qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
+                                  luringcb->qiov->size - total_bytes);
+                ret = 0;
+            }
+        } else {
+            ret = -ENOSPC;
+        }
+    }
+end:
+    luringcb->ret = ret;
+    qemu_iovec_destroy(&luringcb->resubmit_qiov);
+
+    /*
+     * If the coroutine is already entered it must be in ioq_submit()
+     * and will notice luringcb->ret has been filled in when it
+     * eventually runs later. Coroutines cannot be entered recursively
+     * so avoid doing that!
+     */
+    if (!qemu_coroutine_entered(luringcb->co)) {
+        aio_co_wake(luringcb->co);
+    }
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -126,7 +285,6 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 static void luring_process_completions(LuringState *s)
 {
     struct io_uring_cqe *cqes;
-    int total_bytes;
     /*
      * Request completion callbacks can run the nested event loop.
      * Schedule ourselves so the nested event loop will "see" remaining
@@ -144,6 +302,7 @@ static void luring_process_completions(LuringState *s)
      */
     qemu_bh_schedule(s->completion_bh);
 
+    luring_reap(s);
     while (io_uring_peek_cqe(&s->ring, &cqes) == 0) {
         LuringAIOCB *luringcb;
         int ret;
@@ -159,52 +318,20 @@ static void luring_process_completions(LuringState *s)
 
         /* Change counters one-by-one because we can be nested. */
         s->io_q.in_flight--;
+        s->completed++;
         trace_luring_process_completion(s, luringcb, ret);
 
-        /* total_read is non-zero only for resubmitted read requests */
-        total_bytes = ret + luringcb->total_read;
-
-        if (ret < 0) {
-            if (ret == -EINTR) {
-                luring_resubmit(s, luringcb);
-                continue;
-            }
-        } else if (!luringcb->qiov) {
-            goto end;
-        } else if (total_bytes == luringcb->qiov->size) {
-            ret = 0;
-        /* Only read/write */
-        } else {
-            /* Short Read/Write */
-            if (luringcb->is_read) {
-                if (ret > 0) {
-                    luring_resubmit_short_read(s, luringcb, ret);
-                    continue;
-                } else {
-                    /* Pad with zeroes */
-                    qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
-                                      luringcb->qiov->size - total_bytes);
-                    ret = 0;
-                }
-            } else {
-                ret = -ENOSPC;
-            }
-        }
-end:
-        luringcb->ret = ret;
-        qemu_iovec_destroy(&luringcb->resubmit_qiov);
+        luring_complete(s, luringcb, ret);
+    }
 
-        /*
-         * If the coroutine is already entered it must be in ioq_submit()
-         * and will notice luringcb->ret has been filled in when it
-         * eventually runs later. Coroutines cannot be entered recursively
-         * so avoid doing that!
-         */
-        if (!qemu_coroutine_entered(luringcb->co)) {
-            aio_co_wake(luringcb->co);
-        }
+    /*
+     * Keep the BH scheduled while polled requests are in flight, so that
+     * the event loop does not block; it runs again after the other
+     * handlers and polls the device once more.
+     */
+    if (!luring_needs_reap(s)) {
+        qemu_bh_cancel(s->completion_bh);
     }
-    qemu_bh_cancel(s->completion_bh);
 }
 
 static int ioq_submit(LuringState *s)
@@ -227,6 +354,11 @@ static int ioq_submit(LuringState *s)
             *sqes = luringcb->sqeq;
             QSIMPLEQ_REMOVE_HEAD(&s->io_q.submit_queue, next);
         }
+        /* With SQPOLL, liburing only enters the kernel to wake the thread */
+        if (!s->sqpoll ||
+            (qatomic_read(s->ring.sq.kflags) & IORING_SQ_NEED_WAKEUP)) {
+            s->syscalls++;
+        }
         ret = io_uring_submit(&s->ring);
         trace_luring_io_uring_submit(s, ret);
         /* Prevent infinite loop if submission is refused */
@@ -238,6 +370,7 @@ static int ioq_submit(LuringState *s)
         }
         s->io_q.in_flight += ret;
         s->io_q.in_queue  -= ret;
+        s->submitted += ret;
     }
     s->io_q.blocked = (s->io_q.in_queue > 0);
 
@@ -262,6 +395,23 @@ static void luring_process_completions_and_submit(LuringState *s)
     aio_context_release(s->aio_context);
 }
 
+/* Completion of a request that went through the AioContext's io_uring */
+static void luring_uring_request_cb(AioUringRequest *req)
+{
+    LuringAIOCB *luringcb = container_of(req, LuringAIOCB, uring_req);
+    LuringState *s = luringcb->s;
+
+    aio_context_acquire(s->aio_context);
+    s->completed++;
+    trace_luring_process_completion(s, luringcb, req->res);
+    luring_complete(s, luringcb, req->res);
+
+    if (!s->io_q.plugged && s->io_q.in_queue > 0) {
+        ioq_submit(s);
+    }
+    aio_context_release(s->aio_context);
+}
+
 static void qemu_luring_completion_bh(void *opaque)
 {
     LuringState *s = opaque;
@@ -278,6 +428,7 @@ static bool qemu_luring_poll_cb(void *opaque)
 {
     LuringState *s = opaque;
 
+    luring_reap(s);
     if (io_uring_cq_ready(&s->ring)) {
         luring_process_completions_and_submit(s);
         return true;
@@ -312,6 +463,249 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
     }
 }
 
+/**
+ * luring_fixed_file:
+ * @s: AIO state
+ * @fd: file descriptor for I/O
+ *
+ * Returns the index of @fd in the registered file table, adding it if
+ * needed, or -1 if it cannot be registered.
+ */
+static int luring_fixed_file(LuringState *s, int fd)
+{
+    int free_slot = -1;
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < s->nr_fixed_files; i++) {
+        if (s->fixed_files[i] == fd) {
+            return i;
+        }
+        if (free_slot < 0 && s->fixed_files[i] == -1) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        return -1;
+    }
+
+    ret = io_uring_register_files_update(&s->ring, free_slot, &fd, 1);
+    trace_luring_register_file(s, fd, free_slot, ret);
+    if (ret < 0) {
+        return -1;
+    }
+    s->fixed_files[free_slot] = fd;
+    return free_slot;
+}
+
+/**
+ * luring_unregister_fd:
+ * @s: AIO state
+ * @fd: file descriptor that is about to be closed or used elsewhere
+ *
+ * The registered file table keeps the file open, and a new file could get
+ * the same descriptor, so users must call this before closing @fd or
+ * moving it to another AioContext.
+ */
+void luring_unregister_fd(LuringState *s, int fd)
+{
+    LuringAIOCB *luringcb;
+    int unused = -1;
+    unsigned int i;
+
+    for (i = 0; i < s->nr_fixed_files; i++) {
+        if (s->fixed_files[i] == fd) {
+            break;
+        }
+    }
+    if (i == s->nr_fixed_files) {
+        return;
+    }
+
+    /* Requests that are still queued go through the descriptor instead */
+    QSIMPLEQ_FOREACH(luringcb, &s->io_q.submit_queue, next) {
+        if ((luringcb->sqeq.flags & IOSQE_FIXED_FILE) &&
+            luringcb->sqeq.fd == i) {
+            luringcb->sqeq.fd = fd;
+            luringcb->sqeq.flags &= ~IOSQE_FIXED_FILE;
+        }
+    }
+
+    io_uring_register_files_update(&s->ring, i, &unused, 1);
+    s->fixed_files[i] = -1;
+    trace_luring_unregister_file(s, fd, i);
+}
+
+/**
+ * luring_fixed_buf:
+ * @s: AIO state
+ * @qiov: I/O vector of a read or write request
+ *
+ * Returns the fixed buffer index that covers @qiov, or -1 if the request
+ * must use plain vectored I/O.  Only single-element vectors qualify.
+ */
+static int luring_fixed_buf(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t base, offset;
+    unsigned int i;
+
+    if (!s->fixed_bufs_registered || qiov->niov != 1) {
+        return -1;
+    }
+
+    base = (uintptr_t)qiov->iov[0].iov_base;
+    for (i = 0; i < s->fixed_bufs->len; i++) {
+        LuringFixedBuf *buf = &g_array_index(s->fixed_bufs, LuringFixedBuf, i);
+
+        if (base < (uintptr_t)buf->host ||
+            base - (uintptr_t)buf->host >= buf->size) {
+            continue;
+        }
+        offset = base - (uintptr_t)buf->host;
+        if (offset + qiov->iov[0].iov_len > buf->size ||
+            offset % FIXED_BUF_MAX_SIZE + qiov->iov[0].iov_len >
+            FIXED_BUF_MAX_SIZE) {
+            return -1;
+        }
+        return buf->index + offset / FIXED_BUF_MAX_SIZE;
+    }
+    return -1;
+}
+
+/*
+ * Register the fixed buffer table again after a change.  The indices of
+ * the buffers change, so the queued requests that use one are turned into
+ * plain vectored I/O first.
+ */
+static void luring_update_fixed_bufs(LuringState *s)
+{
+    g_autofree struct iovec *iov = NULL;
+    LuringAIOCB *luringcb;
+    unsigned int nr_iov = 0;
+    unsigned int i;
+    size_t off;
+    int ret;
+
+    QSIMPLEQ_FOREACH(luringcb, &s->io_q.submit_queue, next) {
+        switch (luringcb->sqeq.opcode) {
+        case IORING_OP_READ_FIXED:
+            luringcb->sqeq.opcode = IORING_OP_READV;
+            break;
+        case IORING_OP_WRITE_FIXED:
+            luringcb->sqeq.opcode = IORING_OP_WRITEV;
+            break;
+        default:
+            continue;
+        }
+        luringcb->sqeq.addr = (__u64)(uintptr_t)luringcb->qiov->iov;
+        luringcb->sqeq.len = luringcb->qiov->niov;
+        luringcb->sqeq.buf_index = 0;
+    }
+
+    if (s->fixed_bufs_registered) {
+        io_uring_unregister_buffers(&s->ring);
+        s->fixed_bufs_registered = false;
+    }
+    if (!s->fixed_bufs->len) {
+        goto out;
+    }
+
+    for (i = 0; i < s->fixed_bufs->len; i++) {
+        LuringFixedBuf *buf = &g_array_index(s->fixed_bufs, LuringFixedBuf, i);
+
+        buf->index = nr_iov;
+        nr_iov += DIV_ROUND_UP(buf->size, FIXED_BUF_MAX_SIZE);
+    }
+    iov = g_new(struct iovec, nr_iov);
+    for (i = 0; i < s->fixed_bufs->len; i++) {
+        LuringFixedBuf *buf = &g_array_index(s->fixed_bufs, LuringFixedBuf, i);
+
+        for (off = 0; off < buf->size; off += FIXED_BUF_MAX_SIZE) {
+            iov[buf->index + off / FIXED_BUF_MAX_SIZE] = (struct iovec) {
+                .iov_base = buf->host + off,
+                .iov_len = MIN(buf->size - off, FIXED_BUF_MAX_SIZE),
+            };
+        }
+    }
+
+    /*
+     * Like VFIO, the pages stay pinned, so discards (virtio-balloon,
+     * virtio-mem) would not free them.  If a device relies on discards,
+     * do not pin and use plain vectored requests.
+     */
+    if (!s->discard_disabled) {
+        ret = ram_block_discard_disable(true);
+        if (ret) {
+            trace_luring_register_buffers(s, nr_iov, ret);
+            return;
+        }
+        s->discard_disabled = true;
+    }
+
+    /*
+     * This fails if the memory cannot be pinned, e.g. because of
+     * RLIMIT_MEMLOCK or because it is backed by a regular file; I/O to
+     * it then goes through plain vectored requests.
+     */
+    ret = io_uring_register_buffers(&s->ring, iov, nr_iov);
+    trace_luring_register_buffers(s, nr_iov, ret);
+    s->fixed_bufs_registered = (ret == 0);
+
+ out:
+    if (!s->fixed_bufs_registered && s->discard_disabled) {
+        ram_block_discard_disable(false);
+        s->discard_disabled = false;
+    }
+}
+
+/**
+ * luring_register_buf:
+ * @s: AIO state
+ * @host: start of the memory area
+ * @size: size of the memory area
+ *
+ * Make reads and writes that fall within the area use fixed buffers.
+ * Registrations are counted, so each call must be paired with a call to
+ * luring_unregister_buf() with the same @host.
+ */
+void luring_register_buf(LuringState *s, void *host, size_t size)
+{
+    LuringFixedBuf buf = {
+        .host = host,
+        .size = size,
+        .refcnt = 1,
+    };
+    unsigned int i;
+
+    for (i = 0; i < s->fixed_bufs->len; i++) {
+        LuringFixedBuf *old = &g_array_index(s->fixed_bufs, LuringFixedBuf, i);
+
+        if (old->host == host) {
+            old->refcnt++;
+            return;
+        }
+    }
+    g_array_append_val(s->fixed_bufs, buf);
+    luring_update_fixed_bufs(s);
+}
+
+void luring_unregister_buf(LuringState *s, void *host)
+{
+    unsigned int i;
+
+    for (i = 0; i < s->fixed_bufs->len; i++) {
+        LuringFixedBuf *buf = &g_array_index(s->fixed_bufs, LuringFixedBuf, i);
+
+        if (buf->host == host) {
+            if (--buf->refcnt == 0) {
+                g_array_remove_index(s->fixed_bufs, i);
+                luring_update_fixed_bufs(s);
+            }
+            return;
+        }
+    }
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -328,15 +722,48 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    struct io_uring_sqe *sqe = NULL;
+    QEMUIOVector *qiov = luringcb->qiov;
+    int fixed_file = -1;
+    int buf_index = -1;
+
+    if (type == QEMU_AIO_WRITE || type == QEMU_AIO_READ) {
+        buf_index = luring_fixed_buf(s, qiov);
+    }
+
+    /*
+     * Requests without a fixed buffer go through the io_uring that the
+     * AioContext already uses to monitor its file descriptors, so that
+     * submitting them does not cost a system call of its own.  Fixed
+     * files and buffers are only registered with our private ring, and
+     * SQPOLL/IOPOLL are properties of that ring too.
+     */
+    if (buf_index < 0 && !s->sqpoll && !s->iopoll) {
+        sqe = aio_uring_get_sqe(s->aio_context);
+    }
+    if (!sqe) {
+        fixed_file = luring_fixed_file(s, fd);
+        if (fixed_file >= 0) {
+            fd = fixed_file;
+        }
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, qiov->iov[0].iov_base,
+                                      qiov->iov[0].iov_len, offset, buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, qiov->iov, qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, qiov->iov[0].iov_base,
+                                     qiov->iov[0].iov_len, offset, buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, qiov->iov, qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -346,8 +773,17 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (fixed_file >= 0) {
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
+    if (sqe) {
+        luring_submit_shared(s, luringcb, sqe);
+        trace_luring_do_submit_shared(s, luringcb);
+        return 0;
+    }
+
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
     s->io_q.in_queue++;
     trace_luring_do_submit(s, s->io_q.blocked, s->io_q.plugged,
@@ -402,20 +838,74 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_completion_cb, NULL, qemu_luring_poll_cb, s);
 }
 
-LuringState *luring_init(Error **errp)
+/**
+ * luring_supports:
+ * @s: AIO state
+ * @type: type of request
+ * @open_flags: flags the file was opened with
+ *
+ * Returns whether requests of @type on the file can go through @s.  With
+ * IOPOLL the kernel only accepts O_DIRECT reads and writes.
+ */
+bool luring_supports(LuringState *s, int type, int open_flags)
+{
+    if (!s->iopoll) {
+        return true;
+    }
+    return (open_flags & O_DIRECT) &&
+           (type == QEMU_AIO_READ || type == QEMU_AIO_WRITE);
+}
+
+void luring_get_stats(LuringState *s, BlockStatsSpecificIoUring *stats)
+{
+    *stats = (BlockStatsSpecificIoUring) {
+        .sqpoll = s->sqpoll,
+        .iopoll = s->iopoll,
+        .submitted = s->submitted,
+        .completed = s->completed,
+        .syscalls = s->syscalls,
+    };
+}
+
+LuringState *luring_init(const AioIoUringParams *params, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
+    struct io_uring_params p = {};
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    if (params->sqpoll) {
+        p.flags |= IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = params->sq_thread_idle;
+        if (params->sq_thread_cpu >= 0) {
+            p.flags |= IORING_SETUP_SQ_AFF;
+            p.sq_thread_cpu = params->sq_thread_cpu;
+        }
+    }
+    if (params->iopoll) {
+        p.flags |= IORING_SETUP_IOPOLL;
+    }
+
+    rc = io_uring_queue_init_params(MAX_ENTRIES, ring, &p);
     if (rc < 0) {
-        error_setg_errno(errp, errno, "failed to init linux io_uring ring");
+        error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
+    s->sqpoll = params->sqpoll;
+    s->iopoll = params->iopoll;
+
+    /* Needs Linux 5.5 for sparse tables; older kernels go without */
+    memset(s->fixed_files, -1, sizeof(s->fixed_files));
+    rc = io_uring_register_files(ring, s->fixed_files, MAX_FIXED_FILES);
+    trace_luring_register_files(s, MAX_FIXED_FILES, rc);
+    if (rc == 0) {
+        s->nr_fixed_files = MAX_FIXED_FILES;
+    }
+
+    s->fixed_bufs = g_array_new(false, false, sizeof(LuringFixedBuf));
 
     ioq_init(&s->io_q);
     return s;
@@ -424,6 +914,10 @@ LuringState *luring_init(Error **errp)
 
 void luring_cleanup(LuringState *s)
 {
+    if (s->discard_disabled) {
+        ram_block_discard_disable(false);
+    }
+    g_array_free(s->fixed_bufs, true);
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
     g_free(s);
@@ -1831,6 +1831,7 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
 #endif
 
     qemu_co_queue_init(&s->thread_task_queue);
+    qemu_co_queue_init(&s->compressed_alloc_queue);
 
     return ret;
 
@@ -4490,6 +4491,22 @@ fail:
     return ret;
 }
 
+/* Called with s->lock held, waits until @ticket may allocate clusters */
+static void coroutine_fn qcow2_compressed_alloc_wait(BDRVQcow2State *s,
+                                                     uint64_t ticket)
+{
+    while (s->compressed_alloc_cur != ticket) {
+        qemu_co_queue_wait(&s->compressed_alloc_queue, &s->lock);
+    }
+}
+
+/* Called with s->lock held, lets the next compressed write allocate */
+static void coroutine_fn qcow2_compressed_alloc_done(BDRVQcow2State *s)
+{
+    s->compressed_alloc_cur++;
+    qemu_co_queue_restart_all(&s->compressed_alloc_queue);
+}
+
 static coroutine_fn int
 qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
                                  uint64_t offset, uint64_t bytes,
@@ -4500,6 +4517,8 @@ qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
     ssize_t out_len;
     uint8_t *buf, *out_buf;
     uint64_t cluster_offset;
+    /* Taken before the first yield, i.e. in the order the writes start */
+    uint64_t ticket = s->compressed_alloc_next++;
 
     assert(bytes == s->cluster_size || (bytes < s->cluster_size &&
            (offset + bytes == bs->total_sectors << BDRV_SECTOR_BITS)));
@@ -4515,21 +4534,35 @@ qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
 
     out_len = qcow2_co_compress(bs, out_buf, s->cluster_size - 1,
                                 buf, s->cluster_size);
+
+    /* The compression ran in parallel with others, allocation does not */
+    qemu_co_mutex_lock(&s->lock);
+    qcow2_compressed_alloc_wait(s, ticket);
+
     if (out_len == -ENOMEM) {
-        /* could not compress: write normal cluster */
+        /*
+         * could not compress: write normal cluster, still in order, so keep
+         * the others from allocating until it is done
+         */
+        qemu_co_mutex_unlock(&s->lock);
         ret = qcow2_co_pwritev_part(bs, offset, bytes, qiov, qiov_offset, 0);
+        qemu_co_mutex_lock(&s->lock);
+        qcow2_compressed_alloc_done(s);
+        qemu_co_mutex_unlock(&s->lock);
         if (ret < 0) {
             goto fail;
         }
         goto success;
     } else if (out_len < 0) {
+        qcow2_compressed_alloc_done(s);
+        qemu_co_mutex_unlock(&s->lock);
         ret = -EINVAL;
         goto fail;
     }
 
-    qemu_co_mutex_lock(&s->lock);
     ret = qcow2_alloc_compressed_cluster_offset(bs, offset, out_len,
                                                 &cluster_offset);
+    qcow2_compressed_alloc_done(s);
     if (ret < 0) {
         qemu_co_mutex_unlock(&s->lock);
         goto fail;
@@ -409,6 +409,16 @@ typedef struct BDRVQcow2State {
     CoQueue thread_task_queue;
     int nb_threads;
 
+    /*
+     * Compressed clusters are allocated in the order in which their writes
+     * started, not in the order in which their compression finished, so
+     * that the layout of the image does not depend on thread scheduling.
+     * Protected by @lock.
+     */
+    uint64_t compressed_alloc_next;
+    uint64_t compressed_alloc_cur;
+    CoQueue compressed_alloc_queue;
+
     BdrvChild *data_file;
 
     bool metadata_preallocation_checked;
@@ -241,6 +241,18 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Like can_use_fpu, for operations that always round towards zero
+ * whatever the rounding mode of @s.
+ */
+static inline bool can_use_fpu_rtz(const float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely(s->float_exception_flags & float_flag_inexact);
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -2007,13 +2019,41 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(pr, s, fmt16);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts p = float64_unpack_canonical(a, s);
     FloatParts pr = float_to_float(p, &float32_params, s);
     return float32_round_pack_canonical(pr, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    union_float64 ud;
+    union_float32 uf;
+
+    ud.s = a;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ud.s, s);
+    if (unlikely(!float64_is_zero_or_normal(ud.s))) {
+        goto soft;
+    }
+
+    uf.h = ud.h;
+    if (unlikely(f32_is_inf(uf))) {
+        s->float_exception_flags |= float_flag_overflow;
+    } else if (unlikely(fabsf(uf.h) <= FLT_MIN) && !float64_is_zero(ud.s)) {
+        goto soft;
+    }
+    return uf.s;
+
+ soft:
+    return soft_float64_to_float32(ud.s, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts p = bfloat16_unpack_canonical(a, s);
@@ -2310,6 +2350,29 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                  rmode, scale, INT64_MIN, INT64_MAX, s);
 }
 
+/*
+ * Hardfloat conversions to integers.  The host converts a value in range
+ * without raising any flag that matters, since the inexact flag is
+ * already set; NaNs fail the range checks and go to softfloat, which
+ * raises invalid.  For the rounding variants, the host rounds to nearest
+ * even like the guest.
+ */
+static inline bool f64_to_int32_rtz_ok(double d)
+{
+    return d > -2147483649.0 && d < 2147483648.0;
+}
+
+static inline bool f64_to_int32_ok(double d)
+{
+    return d >= -2147483648.0 && d <= 2147483647.0;
+}
+
+/* Truncated or rounded, the values in range are the same. */
+static inline bool f64_to_int64_ok(double d)
+{
+    return d >= -0x1p63 && d < 0x1p63;
+}
+
 int8_t float16_to_int8(float16 a, float_status *s)
 {
     return float16_to_int8_scalbn(a, s->float_rounding_mode, 0, s);
@@ -2337,12 +2400,34 @@ int16_t float32_to_int16(float32 a, float_status *s)
 
 int32_t float32_to_int32(float32 a, float_status *s)
 {
-    return float32_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float32_input_flush1(&ua.s, s);
+        r = rint(ua.h);
+        if (likely(f64_to_int32_ok(r))) {
+            return r;
+        }
+    }
+    return float32_to_int32_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int64_t float32_to_int64(float32 a, float_status *s)
 {
-    return float32_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float32 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float32_input_flush1(&ua.s, s);
+        r = rint(ua.h);
+        if (likely(f64_to_int64_ok(r))) {
+            return r;
+        }
+    }
+    return float32_to_int64_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int16_t float64_to_int16(float64 a, float_status *s)
@@ -2352,12 +2437,34 @@ int16_t float64_to_int16(float64 a, float_status *s)
 
 int32_t float64_to_int32(float64 a, float_status *s)
 {
-    return float64_to_int32_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float64_input_flush1(&ua.s, s);
+        r = rint(ua.h);
+        if (likely(f64_to_int32_ok(r))) {
+            return r;
+        }
+    }
+    return float64_to_int32_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int64_t float64_to_int64(float64 a, float_status *s)
 {
-    return float64_to_int64_scalbn(a, s->float_rounding_mode, 0, s);
+    union_float64 ua;
+    double r;
+
+    ua.s = a;
+    if (likely(can_use_fpu(s))) {
+        float64_input_flush1(&ua.s, s);
+        r = rint(ua.h);
+        if (likely(f64_to_int64_ok(r))) {
+            return r;
+        }
+    }
+    return float64_to_int64_scalbn(ua.s, s->float_rounding_mode, 0, s);
 }
 
 int16_t float16_to_int16_round_to_zero(float16 a, float_status *s)
@@ -2382,12 +2489,30 @@ int16_t float32_to_int16_round_to_zero(float32 a, float_status *s)
 
 int32_t float32_to_int32_round_to_zero(float32 a, float_status *s)
 {
-    return float32_to_int32_scalbn(a, float_round_to_zero, 0, s);
+    union_float32 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu_rtz(s))) {
+        float32_input_flush1(&ua.s, s);
+        if (likely(f64_to_int32_rtz_ok(ua.h))) {
+            return ua.h;
+        }
+    }
+    return float32_to_int32_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 int64_t float32_to_int64_round_to_zero(float32 a, float_status *s)
 {
-    return float32_to_int64_scalbn(a, float_round_to_zero, 0, s);
+    union_float32 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu_rtz(s))) {
+        float32_input_flush1(&ua.s, s);
+        if (likely(f64_to_int64_ok(ua.h))) {
+            return ua.h;
+        }
+    }
+    return float32_to_int64_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
@@ -2397,12 +2522,30 @@ int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
 
 int32_t float64_to_int32_round_to_zero(float64 a, float_status *s)
 {
-    return float64_to_int32_scalbn(a, float_round_to_zero, 0, s);
+    union_float64 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu_rtz(s))) {
+        float64_input_flush1(&ua.s, s);
+        if (likely(f64_to_int32_rtz_ok(ua.h))) {
+            return ua.h;
+        }
+    }
+    return float64_to_int32_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 int64_t float64_to_int64_round_to_zero(float64 a, float_status *s)
 {
-    return float64_to_int64_scalbn(a, float_round_to_zero, 0, s);
+    union_float64 ua;
+
+    ua.s = a;
+    if (likely(can_use_fpu_rtz(s))) {
+        float64_input_flush1(&ua.s, s);
+        if (likely(f64_to_int64_ok(ua.h))) {
+            return ua.h;
+        }
+    }
+    return float64_to_int64_scalbn(ua.s, float_round_to_zero, 0, s);
 }
 
 /*
@@ -2827,14 +2970,36 @@ float32 int16_to_float32_scalbn(int16_t a, int scale, float_status *status)
     return int64_to_float32_scalbn(a, scale, status);
 }
 
+/*
+ * Hardfloat conversions from integers.  Those that fit in the significand
+ * are exact in any rounding mode; the others need the host to round like
+ * the guest, and the inexact flag to be set already.
+ */
+static inline bool int_to_float_exact(int64_t a, int frac_bits)
+{
+    return a >= -(INT64_C(1) << frac_bits) && a <= INT64_C(1) << frac_bits;
+}
+
+static inline bool uint_to_float_exact(uint64_t a, int frac_bits)
+{
+    return a <= UINT64_C(1) << frac_bits;
+}
+
 float32 int64_to_float32(int64_t a, float_status *status)
 {
+    union_float32 ur;
+
+    if (likely(!QEMU_NO_HARDFLOAT &&
+               (int_to_float_exact(a, 24) || can_use_fpu(status)))) {
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
 float32 int32_to_float32(int32_t a, float_status *status)
 {
-    return int64_to_float32_scalbn(a, 0, status);
+    return int64_to_float32(a, status);
 }
 
 float32 int16_to_float32(int16_t a, float_status *status)
@@ -2860,12 +3025,19 @@ float64 int16_to_float64_scalbn(int16_t a, int scale, float_status *status)
 
 float64 int64_to_float64(int64_t a, float_status *status)
 {
+    union_float64 ur;
+
+    if (likely(!QEMU_NO_HARDFLOAT &&
+               (int_to_float_exact(a, 53) || can_use_fpu(status)))) {
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float64_scalbn(a, 0, status);
 }
 
 float64 int32_to_float64(int32_t a, float_status *status)
 {
-    return int64_to_float64_scalbn(a, 0, status);
+    return int64_to_float64(a, status);
 }
 
 float64 int16_to_float64(int16_t a, float_status *status)
@@ -2994,12 +3166,19 @@ float32 uint16_to_float32_scalbn(uint16_t a, int scale, float_status *status)
 
 float32 uint64_to_float32(uint64_t a, float_status *status)
 {
+    union_float32 ur;
+
+    if (likely(!QEMU_NO_HARDFLOAT &&
+               (uint_to_float_exact(a, 24) || can_use_fpu(status)))) {
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float32_scalbn(a, 0, status);
 }
 
 float32 uint32_to_float32(uint32_t a, float_status *status)
 {
-    return uint64_to_float32_scalbn(a, 0, status);
+    return uint64_to_float32(a, status);
 }
 
 float32 uint16_to_float32(uint16_t a, float_status *status)
@@ -3025,12 +3204,19 @@ float64 uint16_to_float64_scalbn(uint16_t a, int scale, float_status *status)
 
 float64 uint64_to_float64(uint64_t a, float_status *status)
 {
+    union_float64 ur;
+
+    if (likely(!QEMU_NO_HARDFLOAT &&
+               (uint_to_float_exact(a, 53) || can_use_fpu(status)))) {
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float64_scalbn(a, 0, status);
 }
 
 float64 uint32_to_float64(uint32_t a, float_status *status)
 {
-    return uint64_to_float64_scalbn(a, 0, status);
+    return uint64_to_float64(a, status);
 }
 
 float64 uint16_to_float64(uint16_t a, float_status *status)
@@ -3179,6 +3365,80 @@ MINMAX(16, max, false, false, false)
 MINMAX(16, maxnum, false, true, false)
 MINMAX(16, maxnummag, false, true, true)
 
+#undef MINMAX
+
+/*
+ * Hardfloat min/max.  Without NaNs, denormals or a pair of zeros, the
+ * result is one of the inputs and no flag is raised, so the host can
+ * pick it in any rounding mode.
+ */
+static float32 QEMU_FLATTEN
+f32_minmax(float32 a, float32 b, bool ismin, bool isiee, bool ismag,
+           float_status *s)
+{
+    union_float32 ua, ub;
+    FloatParts pa, pb, pr;
+
+    ua.s = a;
+    ub.s = b;
+
+    if (QEMU_NO_HARDFLOAT) {
+        goto soft;
+    }
+
+    float32_input_flush2(&ua.s, &ub.s, s);
+    if (likely(f32_is_zon2(ua, ub)) &&
+        !(float32_is_zero(ua.s) && float32_is_zero(ub.s))) {
+        if (ismag && fabsf(ua.h) != fabsf(ub.h)) {
+            return (fabsf(ua.h) < fabsf(ub.h)) ^ ismin ? ub.s : ua.s;
+        }
+        return (ua.h < ub.h) ^ ismin ? ub.s : ua.s;
+    }
+
+ soft:
+    pa = float32_unpack_canonical(ua.s, s);
+    pb = float32_unpack_canonical(ub.s, s);
+    pr = minmax_floats(pa, pb, ismin, isiee, ismag, s);
+    return float32_round_pack_canonical(pr, s);
+}
+
+static float64 QEMU_FLATTEN
+f64_minmax(float64 a, float64 b, bool ismin, bool isiee, bool ismag,
+           float_status *s)
+{
+    union_float64 ua, ub;
+    FloatParts pa, pb, pr;
+
+    ua.s = a;
+    ub.s = b;
+
+    if (QEMU_NO_HARDFLOAT) {
+        goto soft;
+    }
+
+    float64_input_flush2(&ua.s, &ub.s, s);
+    if (likely(f64_is_zon2(ua, ub)) &&
+        !(float64_is_zero(ua.s) && float64_is_zero(ub.s))) {
+        if (ismag && fabs(ua.h) != fabs(ub.h)) {
+            return (fabs(ua.h) < fabs(ub.h)) ^ ismin ? ub.s : ua.s;
+        }
+        return (ua.h < ub.h) ^ ismin ? ub.s : ua.s;
+    }
+
+ soft:
+    pa = float64_unpack_canonical(ua.s, s);
+    pb = float64_unpack_canonical(ub.s, s);
+    pr = minmax_floats(pa, pb, ismin, isiee, ismag, s);
+    return float64_round_pack_canonical(pr, s);
+}
+
+#define MINMAX(sz, name, ismin, isiee, ismag)                           \
+float ## sz float ## sz ## _ ## name(float ## sz a, float ## sz b,      \
+                                     float_status *s)                   \
+{                                                                       \
+    return f ## sz ## _minmax(a, b, ismin, isiee, ismag, s);            \
+}
+
 MINMAX(32, min, true, false, false)
 MINMAX(32, minnum, true, true, false)
 MINMAX(32, minnummag, true, true, true)
@@ -295,7 +295,8 @@ ERST
 
 SRST
   ``info opcount``
-    Show dynamic compiler opcode counters
+    Show dynamic compiler opcode counters, and the number of redundant
+    operations, loads and stores that the optimizer removed
 ERST
 
     {
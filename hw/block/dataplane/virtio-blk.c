@@ -43,6 +43,10 @@ struct VirtIOBlockDataPlane {
      */
     IOThread *iothread;
     AioContext *ctx;
+
+    /* IOThreads referenced by the iothread-vq-mapping property */
+    IOThread **vq_iothreads;
+    unsigned num_vq_iothreads;
 };
 
 /* Raise an interrupt to signal guest, if necessary */
@@ -80,6 +84,83 @@ static void notify_guest_bh(void *opaque)
     }
 }
 
+/*
+ * Parse the iothread-vq-mapping property, a colon-separated list of IOThread
+ * ids to which the virtqueues are assigned round-robin.
+ *
+ * The block layer only accepts requests for a BlockBackend in its own
+ * AioContext.  Virtqueue handlers in other IOThreads would bounce every
+ * request there and serialize on its lock, which adds latency without any
+ * parallelism, and the drain of the BlockBackend would not stop them.
+ * Until requests can be submitted from several AioContexts, all virtqueues
+ * are handled by the first IOThread of the mapping.
+ *
+ * Context: QEMU global mutex held
+ */
+static bool apply_iothread_vq_mapping(VirtIOBlockDataPlane *s,
+                                      const char *mapping, Error **errp)
+{
+    g_auto(GStrv) ids = g_strsplit(mapping, ":", -1);
+    unsigned num_iothreads = g_strv_length(ids);
+    unsigned num_queues = s->conf->num_queues;
+    unsigned i;
+
+    if (num_iothreads == 0) {
+        error_setg(errp, "iothread-vq-mapping must name at least one IOThread");
+        return false;
+    }
+    if (num_iothreads > num_queues) {
+        error_setg(errp, "iothread-vq-mapping names %u IOThreads but there "
+                   "are only %u virtqueues", num_iothreads, num_queues);
+        return false;
+    }
+
+    s->vq_iothreads = g_new0(IOThread *, num_iothreads);
+    s->num_vq_iothreads = num_iothreads;
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        IOThread *iothread = iothread_by_id(ids[i]);
+
+        if (!iothread) {
+            error_setg(errp, "IOThread \"%s\" object does not exist", ids[i]);
+            return false;
+        }
+        object_ref(OBJECT(iothread));
+        s->vq_iothreads[i] = iothread;
+    }
+
+    for (i = 1; i < s->num_vq_iothreads; i++) {
+        if (s->vq_iothreads[i] != s->vq_iothreads[0]) {
+            warn_report("iothread-vq-mapping: all virtqueues are handled by "
+                        "IOThread \"%s\", requests cannot be submitted from "
+                        "several AioContexts yet", ids[0]);
+            break;
+        }
+    }
+
+    s->ctx = iothread_get_aio_context(s->vq_iothreads[0]);
+    return true;
+}
+
+static void virtio_blk_data_plane_free(VirtIOBlockDataPlane *s)
+{
+    unsigned i;
+
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        if (s->vq_iothreads[i]) {
+            object_unref(OBJECT(s->vq_iothreads[i]));
+        }
+    }
+    g_free(s->vq_iothreads);
+    g_free(s->batch_notify_vqs);
+    if (s->bh) {
+        qemu_bh_delete(s->bh);
+    }
+    if (s->iothread) {
+        object_unref(OBJECT(s->iothread));
+    }
+    g_free(s);
+}
+
 /* Context: QEMU global mutex held */
 bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
                                   VirtIOBlockDataPlane **dataplane,
@@ -91,7 +172,14 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
 
     *dataplane = NULL;
 
-    if (conf->iothread) {
+    if (conf->iothread && conf->iothread_vq_mapping) {
+        error_setg(errp,
+                   "iothread and iothread-vq-mapping properties cannot be set "
+                   "at the same time");
+        return false;
+    }
+
+    if (conf->iothread || conf->iothread_vq_mapping) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -120,7 +208,12 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     s->vdev = vdev;
     s->conf = conf;
 
-    if (conf->iothread) {
+    if (conf->iothread_vq_mapping) {
+        if (!apply_iothread_vq_mapping(s, conf->iothread_vq_mapping, errp)) {
+            virtio_blk_data_plane_free(s);
+            return false;
+        }
+    } else if (conf->iothread) {
         s->iothread = conf->iothread;
         object_ref(OBJECT(s->iothread));
         s->ctx = iothread_get_aio_context(s->iothread);
@@ -146,12 +239,7 @@ void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
 
     vblk = VIRTIO_BLK(s->vdev);
     assert(!vblk->dataplane_started);
-    g_free(s->batch_notify_vqs);
-    qemu_bh_delete(s->bh);
-    if (s->iothread) {
-        object_unref(OBJECT(s->iothread));
-    }
-    g_free(s);
+    virtio_blk_data_plane_free(s);
 }
 
 static bool virtio_blk_data_plane_handle_output(VirtIODevice *vdev,
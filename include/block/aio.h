@@ -121,6 +121,31 @@ struct BHListSlice {
 
 typedef QSLIST_HEAD(, AioHandler) AioHandlerSList;
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * A request on the io_uring that an AioContext uses for file descriptor
+ * monitoring, see aio_uring_get_sqe().
+ */
+typedef struct AioUringRequest AioUringRequest;
+struct AioUringRequest {
+    /* Called by aio_poll() once the request has completed */
+    void (*cb)(AioUringRequest *req);
+
+    /* The result of the request, valid in @cb */
+    int res;
+
+    QSIMPLEQ_ENTRY(AioUringRequest) next;
+};
+#endif
+
+/* Setup of the io_uring for block I/O, see aio_context_set_io_uring_params */
+typedef struct AioIoUringParams {
+    bool sqpoll;                /* submit from a kernel thread */
+    uint32_t sq_thread_idle;    /* ms before the kernel thread sleeps */
+    int sq_thread_cpu;          /* CPU of the kernel thread, -1 for any */
+    bool iopoll;                /* poll the device for completions */
+} AioIoUringParams;
+
 struct AioContext {
     GSource source;
 
@@ -210,10 +235,16 @@ struct AioContext {
      * locking.
      */
     struct LuringState *linux_io_uring;
+    AioIoUringParams linux_io_uring_params;
 
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+    AioHandlerList fdmon_io_uring_parked;
+    QSIMPLEQ_HEAD(, AioUringRequest) uring_completed;
+
+    /* aio_uring_get_sqe() requests that have not completed yet */
+    unsigned int uring_requests;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -727,4 +758,45 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+#ifdef CONFIG_LINUX_IO_URING
+/**
+ * aio_uring_get_sqe:
+ * @ctx: the aio context
+ *
+ * Returns an sqe on the io_uring that @ctx uses to monitor file
+ * descriptors, or NULL if @ctx does not use one or is not the current
+ * thread's AioContext.  The caller prepares the sqe and passes it to
+ * aio_uring_sqe_set_request() right away.
+ *
+ * The request is submitted by the io_uring_enter() that the event loop
+ * makes anyway to wait for events, and completes in the same way, so
+ * that I/O needs no system calls of its own.
+ */
+struct io_uring_sqe *aio_uring_get_sqe(AioContext *ctx);
+
+/**
+ * aio_uring_sqe_set_request:
+ * @sqe: an sqe from aio_uring_get_sqe()
+ * @req: the request, with @cb filled in
+ *
+ * Make aio_poll() call @req->cb when @sqe completes.  This overwrites the
+ * user_data field of @sqe.
+ */
+void aio_uring_sqe_set_request(struct io_uring_sqe *sqe, AioUringRequest *req);
+#endif
+
+/**
+ * aio_context_set_io_uring_params:
+ * @ctx: the aio context
+ * @params: how to set up the io_uring used for block I/O
+ *
+ * With SQPOLL and polled completions the event loop can submit and
+ * complete requests without system calls while it is busy.  This must be
+ * called before the io_uring is set up, i.e. before any block device
+ * that uses aio=io_uring is attached to @ctx.
+ */
+void aio_context_set_io_uring_params(AioContext *ctx,
+                                     const AioIoUringParams *params,
+                                     Error **errp);
+
 #endif
@@ -19,6 +19,7 @@
 #include "block/aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/iov.h"
+#include "qapi/qapi-types-block-core.h"
 
 /* AIO request types */
 #define QEMU_AIO_READ         0x0001
@@ -60,7 +61,9 @@ void laio_io_unplug(BlockDriverState *bs, LinuxAioState *s);
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
 typedef struct LuringState LuringState;
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(const AioIoUringParams *params, Error **errp);
+bool luring_supports(LuringState *s, int type, int open_flags);
+void luring_get_stats(LuringState *s, BlockStatsSpecificIoUring *stats);
 void luring_cleanup(LuringState *s);
 int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
                                 uint64_t offset, QEMUIOVector *qiov, int type);
@@ -68,6 +71,9 @@ void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
 void luring_io_plug(BlockDriverState *bs, LuringState *s);
 void luring_io_unplug(BlockDriverState *bs, LuringState *s);
+void luring_unregister_fd(LuringState *s, int fd);
+void luring_register_buf(LuringState *s, void *host, size_t size);
+void luring_unregister_buf(LuringState *s, void *host);
 #endif
 
 #ifdef _WIN32
@@ -79,6 +79,9 @@ typedef uint64_t target_ulong;
 /* use a fully associative victim tlb of 8 entries */
 #define CPU_VTLB_SIZE 8
 
+/* remember up to 16 large pages per mmu_idx, fully associative */
+#define CPU_LTLB_SIZE 16
+
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
 #else
@@ -150,19 +153,39 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * A page larger than TARGET_PAGE_SIZE, whose translation has been
+ * given to tlb_set_page.  The tlb itself only holds TARGET_PAGE_SIZE
+ * entries; this records which of them to flush together and, if the
+ * target said the page maps contiguously, what is needed to create the
+ * entry of any other page within it without going through tlb_fill.
+ */
+typedef struct CPUTLBLargeEntry {
+    /* The first address of the page, or -1 if the entry is unused.  */
+    target_ulong vaddr;
+    /* ~(size - 1); the page is matched if (addr & mask) == vaddr.  */
+    target_ulong mask;
+    hwaddr paddr;
+    MemTxAttrs attrs;
+    int prot;
+    /* From tlb_set_large_page_with_attrs; paddr, attrs and prot apply.  */
+    bool contiguous;
+} CPUTLBLargeEntry;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * The large pages that may have entries in the tlb.  When any page
+     * within one of them is flushed, we flush all the entries of that
+     * large page; when one of them is evicted, so are its entries.
      */
-    target_ulong large_page_addr;
-    target_ulong large_page_mask;
+    size_t n_large_pages;
+    /* The next index to use in the large page table.  */
+    size_t lindex;
+    CPUTLBLargeEntry ltable[CPU_LTLB_SIZE];
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -208,6 +231,8 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t large_fill_count;
+    size_t large_flush_count;
 } CPUTLBCommon;
 
 /*
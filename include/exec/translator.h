@@ -60,8 +60,11 @@ typedef enum DisasJumpType {
  * @pc_next: Address of next guest instruction in this TB (current during
  *           disassembly).
  * @is_jmp: What instruction to disassemble next.
+ * @pc_max: End of the guest code translated before the last jump followed
+ *          by translator_trace_jump().
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
+ * @num_jumps: Number of jumps followed by translator_trace_jump().
  * @singlestep_enabled: "Hardware" single stepping enabled.
  *
  * Architecture-agnostic disassembly context.
@@ -70,9 +73,11 @@ typedef struct DisasContextBase {
     const TranslationBlock *tb;
     target_ulong pc_first;
     target_ulong pc_next;
+    target_ulong pc_max;
     DisasJumpType is_jmp;
     int num_insns;
     int max_insns;
+    int num_jumps;
     bool singlestep_enabled;
 } DisasContextBase;
 
@@ -145,6 +150,26 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_trace_jump:
+ * @db: Disassembly context.
+ * @insn_end: Address following the jump instruction.
+ * @dest: Destination of the jump.
+ *
+ * Return true if a TB translated with CF_TRACE may keep translating at
+ * @dest instead of ending with a jump to it.  The target then sets
+ * db->pc_next to @dest and leaves db->is_jmp to DISAS_NEXT.  An
+ * unconditional jump becomes a no-op in the generated code, and the
+ * optimizer and register allocator see the code before and after it as
+ * one block.  A conditional branch still needs a side exit for the path
+ * that is not followed, and its brcond and label end a TCG basic block.
+ *
+ * Only destinations in the first page of the TB are followed, so that
+ * [tb->pc, tb->pc + tb->size) still covers all of the translated code.
+ */
+bool translator_trace_jump(DisasContextBase *db, target_ulong insn_end,
+                           target_ulong dest);
+
 /*
  * Translator Load Functions
  *
@@ -67,6 +67,7 @@ enum plugin_dyn_cb_type {
 
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
+    PLUGIN_CB_REGULAR_COND,
     PLUGIN_CB_INLINE,
     PLUGIN_N_CB_SUBTYPES,
 };
@@ -88,10 +89,27 @@ struct qemu_plugin_dyn_cb {
         struct {
             enum qemu_plugin_op op;
             uint64_t imm;
+            /* if @entry.score is NULL, the op applies to @userp */
+            qemu_plugin_u64 entry;
         } inline_insn;
+        /* the regular callback is only called if @entry @cond @imm */
+        struct {
+            qemu_plugin_u64 entry;
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+        } cond;
     };
 };
 
+/*
+ * A scoreboard holds one entry per vCPU; @data is resized, and thus may
+ * move, whenever a vCPU whose index is beyond its size is created.
+ */
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
 struct qemu_plugin_insn {
     GByteArray *data;
     uint64_t vaddr;
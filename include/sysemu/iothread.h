@@ -37,6 +37,9 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* io_uring parameters, fixed once the IOThread is created */
+    AioIoUringParams io_uring_params;
 };
 typedef struct IOThread IOThread;
 
@@ -568,6 +568,27 @@ typedef struct TCGOp {
 /* Make sure operands fit in the bitfields above.  */
 QEMU_BUILD_BUG_ON(NB_OPS > (1 << 8));
 
+/*
+ * A reference from the generated code to a host address, see
+ * tcg_out_ext_ref().  The value of a PCREL32 reference is encoded as
+ * its displacement from the address of the field plus @addend.
+ */
+typedef enum TCGExtRefKind {
+    TCG_EXT_REF_ABS64,
+    TCG_EXT_REF_ABS32U,
+    TCG_EXT_REF_ABS32S,
+    TCG_EXT_REF_PCREL32,
+} TCGExtRefKind;
+
+typedef struct TCGExtRef {
+    uint32_t offset;    /* of the field from the start of the TB code */
+    uint8_t kind;
+    int8_t addend;
+    uintptr_t value;
+} TCGExtRef;
+
+#define TCG_MAX_EXT_REFS 1024
+
 typedef struct TCGProfile {
     int64_t cpu_exec_time;
     int64_t tb_count1;
@@ -587,6 +608,9 @@ typedef struct TCGProfile {
     int64_t restore_count;
     int64_t restore_time;
     int64_t table_op_count[NB_OPS];
+    int64_t gvn_count;        /* redundant ops turned into moves */
+    int64_t load_elim_count;  /* env loads of a known value */
+    int64_t store_elim_count; /* env stores that were dead or redundant */
 } TCGProfile;
 
 struct TCGContext {
@@ -681,6 +705,13 @@ struct TCGContext {
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
 
+#ifdef TCG_TARGET_EXT_REFS
+    /* References of the last TB to host addresses, -1 if too many */
+    bool ext_refs_enabled;
+    int nb_ext_refs;
+    TCGExtRef ext_refs[TCG_MAX_EXT_REFS];
+#endif
+
     /* Exit to translator on overflow. */
     sigjmp_buf jmp_trans;
 };
@@ -877,6 +908,10 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 void tcg_region_init(void);
 void tb_destroy(TranslationBlock *tb);
 void tcg_region_reset_all(void);
+size_t tcg_nb_regions(void);
+size_t tcg_region_index(const void *tc_ptr);
+size_t tcg_region_evict(const unsigned int *hits, GTraverseFunc invalidate,
+                        gpointer data);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -26,6 +26,17 @@
 #include "io/channel-watch.h"
 #include "trace.h"
 #include "qapi/clone-visitor.h"
+#include "qemu/coroutine.h"
+#include "block/aio.h"
+
+#ifdef CONFIG_LINUX
+#include <linux/errqueue.h>
+#include <sys/socket.h>
+
+#if (defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY))
+#define QEMU_MSG_ZEROCOPY
+#endif
+#endif
 
 #define SOCKET_MAX_FDS 16
 
@@ -140,6 +151,9 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
                                     Error **errp)
 {
     int fd;
+#ifdef QEMU_MSG_ZEROCOPY
+    int v = 1;
+#endif
 
     trace_qio_channel_socket_connect_sync(ioc, addr);
     fd = socket_connect(addr, errp);
@@ -154,6 +168,14 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
         return -1;
     }
 
+#ifdef QEMU_MSG_ZEROCOPY
+    if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == 0) {
+        /* Zero copy available on host */
+        qio_channel_set_feature(QIO_CHANNEL(ioc),
+                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+    }
+#endif
+
     return 0;
 }
 
@@ -471,6 +493,76 @@ static void qio_channel_socket_copy_fds(struct msghdr *msg,
     }
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+typedef struct QIOChannelSocketUringReq {
+    AioUringRequest req;
+    Coroutine *co;
+    bool done;
+} QIOChannelSocketUringReq;
+
+static void qio_channel_socket_uring_cb(AioUringRequest *req)
+{
+    QIOChannelSocketUringReq *r = container_of(req, QIOChannelSocketUringReq,
+                                               req);
+
+    r->done = true;
+    aio_co_wake(r->co);
+}
+
+/*
+ * In a coroutine of an AioContext that monitors its file descriptors
+ * with io_uring, send or receive @msg through that ring, so that the
+ * system call is batched with the rest of the AioContext's I/O.
+ *
+ * Returns false if the caller has to do the system call itself.
+ * Otherwise @ret is the result, with errno set if it is negative.
+ */
+static bool qio_channel_socket_uring_msg(QIOChannelSocket *sioc,
+                                         struct msghdr *msg, int sflags,
+                                         bool is_write, ssize_t *ret)
+{
+    QIOChannelSocketUringReq r = {
+        .req.cb = qio_channel_socket_uring_cb,
+    };
+    struct io_uring_sqe *sqe;
+
+    if (!qemu_in_coroutine()) {
+        return false;
+    }
+    sqe = aio_uring_get_sqe(qemu_get_current_aio_context());
+    if (!sqe) {
+        return false;
+    }
+
+    if (is_write) {
+        io_uring_prep_sendmsg(sqe, sioc->fd, msg, sflags);
+    } else {
+        io_uring_prep_recvmsg(sqe, sioc->fd, msg, sflags);
+    }
+    r.co = qemu_coroutine_self();
+    aio_uring_sqe_set_request(sqe, &r.req);
+
+    while (!r.done) {
+        qemu_coroutine_yield();
+    }
+
+    if (r.req.res < 0) {
+        errno = -r.req.res;
+        *ret = -1;
+    } else {
+        *ret = r.req.res;
+    }
+    return true;
+}
+#else
+static bool qio_channel_socket_uring_msg(QIOChannelSocket *sioc,
+                                         struct msghdr *msg, int sflags,
+                                         bool is_write, ssize_t *ret)
+{
+    return false;
+}
+#endif
+
 
 static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
                                         const struct iovec *iov,
@@ -499,7 +591,9 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
     }
 
  retry:
-    ret = recvmsg(sioc->fd, &msg, sflags);
+    if (!qio_channel_socket_uring_msg(sioc, &msg, sflags, false, &ret)) {
+        ret = recvmsg(sioc->fd, &msg, sflags);
+    }
     if (ret < 0) {
         if (errno == EAGAIN) {
             return QIO_CHANNEL_ERR_BLOCK;
@@ -525,6 +619,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
                                          size_t niov,
                                          int *fds,
                                          size_t nfds,
+                                         int flags,
                                          Error **errp)
 {
     QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
@@ -533,6 +628,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
     char control[CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS)];
     size_t fdsize = sizeof(int) * nfds;
     struct cmsghdr *cmsg;
+    int sflags = 0;
 
     memset(control, 0, CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS));
 
@@ -557,8 +653,18 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
         memcpy(CMSG_DATA(cmsg), fds, fdsize);
     }
 
+#ifdef QEMU_MSG_ZEROCOPY
+    if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+        sflags = MSG_ZEROCOPY;
+    }
+#endif
+
  retry:
-    ret = sendmsg(sioc->fd, &msg, 0);
+    /* The completions of MSG_ZEROCOPY are read from the error queue */
+    if (sflags ||
+        !qio_channel_socket_uring_msg(sioc, &msg, sflags, true, &ret)) {
+        ret = sendmsg(sioc->fd, &msg, sflags);
+    }
     if (ret <= 0) {
         if (errno == EAGAIN) {
             return QIO_CHANNEL_ERR_BLOCK;
@@ -566,10 +672,22 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
         if (errno == EINTR) {
             goto retry;
         }
+#ifdef QEMU_MSG_ZEROCOPY
+        if (errno == ENOBUFS && (sflags & MSG_ZEROCOPY)) {
+            error_setg_errno(errp, errno,
+                             "Process can't lock enough memory for using "
+                             "MSG_ZEROCOPY");
+            return -1;
+        }
+#endif
         error_setg_errno(errp, errno,
                          "Unable to write to socket");
         return -1;
     }
+
+    if (sflags) {
+        sioc->zero_copy_queued++;
+    }
     return ret;
 }
 #else /* WIN32 */
@@ -620,6 +738,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
                                          size_t niov,
                                          int *fds,
                                          size_t nfds,
+                                         int flags,
                                          Error **errp)
 {
     QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
@@ -698,6 +817,76 @@ qio_channel_socket_set_cork(QIOChannel *ioc,
 }
 
 
+#ifdef QEMU_MSG_ZEROCOPY
+static int qio_channel_socket_flush(QIOChannel *ioc,
+                                    Error **errp)
+{
+    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+    struct msghdr msg = {};
+    struct sock_extended_err *serr;
+    struct cmsghdr *cm;
+    char control[CMSG_SPACE(sizeof(*serr))];
+    int received;
+    int ret = 1;
+
+    /*
+     * Each successful MSG_ZEROCOPY sendmsg() is acknowledged on the socket
+     * error queue; a single notification can cover a range of calls.
+     */
+    while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        received = recvmsg(sioc->fd, &msg, MSG_ERRQUEUE);
+        if (received < 0) {
+            if (errno == EAGAIN) {
+                /* Nothing on the error queue yet, wait for it */
+                qio_channel_wait(ioc, G_IO_ERR);
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            error_setg_errno(errp, errno,
+                             "Unable to read socket error queue");
+            return -1;
+        }
+
+        cm = CMSG_FIRSTHDR(&msg);
+        if (!cm ||
+            !((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+              (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+            error_setg_errno(errp, EPROTOTYPE,
+                             "Wrong cmsg in socket error queue");
+            return -1;
+        }
+
+        serr = (void *) CMSG_DATA(cm);
+        if (serr->ee_errno != SO_EE_ORIGIN_NONE) {
+            error_setg_errno(errp, serr->ee_errno,
+                             "Error on socket");
+            return -1;
+        }
+        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+            error_setg_errno(errp, serr->ee_origin,
+                             "Error not from zero copy");
+            return -1;
+        }
+
+        /* No errors, count the sendmsg() calls that completed */
+        sioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
+
+        /* If any sendmsg() succeeded without copying, report success */
+        if (serr->ee_code != SO_EE_CODE_ZEROCOPY_COPIED) {
+            ret = 0;
+        }
+    }
+
+    return ret;
+}
+#endif /* QEMU_MSG_ZEROCOPY */
+
 static int
 qio_channel_socket_close(QIOChannel *ioc,
                          Error **errp)
@@ -787,6 +976,9 @@ static void qio_channel_socket_class_init(ObjectClass *klass,
     ioc_klass->io_set_delay = qio_channel_socket_set_delay;
     ioc_klass->io_create_watch = qio_channel_socket_create_watch;
     ioc_klass->io_set_aio_fd_handler = qio_channel_socket_set_aio_fd_handler;
+#ifdef QEMU_MSG_ZEROCOPY
+    ioc_klass->io_flush = qio_channel_socket_flush;
+#endif
 }
 
 static const TypeInfo qio_channel_socket_info = {
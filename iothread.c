@@ -113,6 +113,7 @@ static void iothread_instance_init(Object *obj)
     IOThread *iothread = IOTHREAD(obj);
 
     iothread->poll_max_ns = IOTHREAD_POLL_MAX_NS_DEFAULT;
+    iothread->io_uring_params.sq_thread_cpu = -1;
     iothread->thread_id = -1;
     qemu_sem_init(&iothread->init_done_sem, 0);
     /* By default, we don't run gcontext */
@@ -183,6 +184,11 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
                                 iothread->poll_grow,
                                 iothread->poll_shrink,
                                 &local_error);
+    if (!local_error) {
+        aio_context_set_io_uring_params(iothread->ctx,
+                                        &iothread->io_uring_params,
+                                        &local_error);
+    }
     if (local_error) {
         error_propagate(errp, local_error);
         aio_context_unref(iothread->ctx);
@@ -259,6 +265,92 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
     }
 }
 
+static bool iothread_check_io_uring_param(IOThread *iothread, Error **errp)
+{
+    if (iothread->ctx) {
+        error_setg(errp, "io_uring parameters cannot be changed after the "
+                   "IOThread is created");
+        return false;
+    }
+    return true;
+}
+
+static bool iothread_get_io_uring_sqpoll(Object *obj, Error **errp)
+{
+    return IOTHREAD(obj)->io_uring_params.sqpoll;
+}
+
+static void iothread_set_io_uring_sqpoll(Object *obj, bool value, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread_check_io_uring_param(iothread, errp)) {
+        iothread->io_uring_params.sqpoll = value;
+    }
+}
+
+static bool iothread_get_io_uring_iopoll(Object *obj, Error **errp)
+{
+    return IOTHREAD(obj)->io_uring_params.iopoll;
+}
+
+static void iothread_set_io_uring_iopoll(Object *obj, bool value, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread_check_io_uring_param(iothread, errp)) {
+        iothread->io_uring_params.iopoll = value;
+    }
+}
+
+static void iothread_get_io_uring_sq_thread_idle(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    visit_type_uint32(v, name, &iothread->io_uring_params.sq_thread_idle,
+                      errp);
+}
+
+static void iothread_set_io_uring_sq_thread_idle(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    uint32_t value;
+
+    if (!iothread_check_io_uring_param(iothread, errp) ||
+        !visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    iothread->io_uring_params.sq_thread_idle = value;
+}
+
+static void iothread_get_io_uring_sq_thread_cpu(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    int64_t value = iothread->io_uring_params.sq_thread_cpu;
+
+    visit_type_int64(v, name, &value, errp);
+}
+
+static void iothread_set_io_uring_sq_thread_cpu(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    int64_t value;
+
+    if (!iothread_check_io_uring_param(iothread, errp) ||
+        !visit_type_int64(v, name, &value, errp)) {
+        return;
+    }
+    if (value < -1 || value > INT_MAX) {
+        error_setg(errp, "%s value must be -1 or a CPU number", name);
+        return;
+    }
+    iothread->io_uring_params.sq_thread_cpu = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(klass);
@@ -276,6 +368,21 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+
+    object_class_property_add_bool(klass, "io-uring-sqpoll",
+                                   iothread_get_io_uring_sqpoll,
+                                   iothread_set_io_uring_sqpoll);
+    object_class_property_add(klass, "io-uring-sq-thread-idle", "uint32",
+                              iothread_get_io_uring_sq_thread_idle,
+                              iothread_set_io_uring_sq_thread_idle,
+                              NULL, NULL);
+    object_class_property_add(klass, "io-uring-sq-thread-cpu", "int",
+                              iothread_get_io_uring_sq_thread_cpu,
+                              iothread_set_io_uring_sq_thread_cpu,
+                              NULL, NULL);
+    object_class_property_add_bool(klass, "io-uring-iopoll",
+                                   iothread_get_io_uring_iopoll,
+                                   iothread_set_io_uring_iopoll);
 }
 
 static const TypeInfo iothread_info = {
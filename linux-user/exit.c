@@ -34,6 +34,7 @@ void preexit_cleanup(CPUArchState *env, int code)
 #ifdef CONFIG_GCOV
         __gcov_dump();
 #endif
+        tb_tier_shutdown();
         gdb_exit(code);
         qemu_plugin_atexit_cb();
 }
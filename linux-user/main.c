@@ -130,10 +130,12 @@ void fork_start(void)
     start_exclusive();
     mmap_fork_start();
     cpu_list_lock();
+    tb_tier_fork_start();
 }
 
 void fork_end(int child)
 {
+    tb_tier_fork_end(child);
     mmap_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
@@ -375,6 +377,18 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static void handle_arg_tier(const char *arg)
+{
+    object_property_parse(OBJECT(current_accel()), "tier-threshold", arg,
+                          &error_fatal);
+}
+
+static void handle_arg_tier_trace(const char *arg)
+{
+    object_property_parse(OBJECT(current_accel()), "tier-trace", "on",
+                          &error_fatal);
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -453,6 +467,10 @@ static const struct qemu_argument arg_table[] = {
      "pagesize",   "set the host page size to 'pagesize'"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
+    {"tier",       "QEMU_TIER",        true,  handle_arg_tier,
+     "count",      "optimize code in the background once run 'count' times"},
+    {"tier-trace", "QEMU_TIER_TRACE",  false, handle_arg_tier_trace,
+     "",           "optimize hot code across direct jumps"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
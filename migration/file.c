@@ -0,0 +1,114 @@
+/*
+ * QEMU live migration to and from a file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "channel.h"
+#include "file.h"
+#include "migration.h"
+#include "io/channel-file.h"
+#include "trace.h"
+
+
+static struct FileOutgoingArgs {
+    char *fname;
+} outgoing_args;
+
+static struct FileIncomingArgs {
+    char *fname;
+} incoming_args;
+
+/*
+ * Open another channel on the file being written, for use by a multifd
+ * send thread.  Every channel writes its pages at their own position in
+ * the file, so the channels do not need to share a file offset.
+ *
+ * Returns false and sets @errp if the file cannot be opened; @f is only
+ * called when the channel was created.
+ */
+bool file_send_channel_create(QIOTaskFunc f, void *data, Error **errp)
+{
+    QIOChannelFile *ioc;
+    QIOTask *task;
+
+    ioc = qio_channel_file_new_path(outgoing_args.fname, O_WRONLY, 0, errp);
+    if (!ioc) {
+        return false;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "migration-file-multifd");
+
+    task = qio_task_new(OBJECT(ioc), f, data, NULL);
+    qio_task_complete(task);
+    return true;
+}
+
+/*
+ * Open another channel on the file being loaded, for the threads that
+ * read the pages of a postcopy-from-file migration at their position.
+ */
+QIOChannel *file_incoming_channel_create(Error **errp)
+{
+    QIOChannelFile *ioc;
+
+    ioc = qio_channel_file_new_path(incoming_args.fname, O_RDONLY, 0, errp);
+    if (!ioc) {
+        return NULL;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "migration-file-postcopy");
+    return QIO_CHANNEL(ioc);
+}
+
+void file_start_outgoing_migration(MigrationState *s, const char *filename,
+                                   Error **errp)
+{
+    QIOChannelFile *ioc;
+
+    trace_migration_file_outgoing(filename);
+
+    ioc = qio_channel_file_new_path(filename, O_CREAT | O_WRONLY | O_TRUNC,
+                                    0600, errp);
+    if (!ioc) {
+        return;
+    }
+
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(ioc), "migration-file-outgoing");
+    migration_channel_connect(s, QIO_CHANNEL(ioc), NULL, NULL);
+    object_unref(OBJECT(ioc));
+}
+
+static gboolean file_accept_incoming_migration(QIOChannel *ioc,
+                                               GIOCondition condition,
+                                               gpointer opaque)
+{
+    migration_channel_process_incoming(ioc);
+    object_unref(OBJECT(ioc));
+    return G_SOURCE_REMOVE;
+}
+
+void file_start_incoming_migration(const char *filename, Error **errp)
+{
+    QIOChannelFile *ioc;
+
+    trace_migration_file_incoming(filename);
+
+    ioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
+    if (!ioc) {
+        return;
+    }
+
+    g_free(incoming_args.fname);
+    incoming_args.fname = g_strdup(filename);
+
+    qio_channel_set_name(QIO_CHANNEL(ioc), "migration-file-incoming");
+    qio_channel_add_watch_full(QIO_CHANNEL(ioc), G_IO_IN,
+                               file_accept_incoming_migration,
+                               NULL, NULL,
+                               g_main_context_get_thread_default());
+}
@@ -122,6 +122,23 @@ struct MigrationIncomingState {
      * contains valid information.
      */
     QemuMutex page_request_mutex;
+
+    /*
+     * postcopy-from-file: the faults are served by reading the pages from
+     * this channel on the mapped-ram file, instead of requesting them
+     * from the source.
+     */
+    QIOChannel *postcopy_file_ioc;
+    /* Serializes the placing of pages by the fault and prefetch threads */
+    QemuMutex postcopy_file_mutex;
+    /* Loads the pages that have not been faulted in yet */
+    bool have_prefetch_thread;
+    QemuThread prefetch_thread;
+    /* Posted once the guest is started, lets the prefetch thread finish */
+    QemuSemaphore prefetch_run_sem;
+    /* Host pages placed on a fault, and by the prefetch thread */
+    uint64_t postcopy_file_faults;
+    uint64_t postcopy_file_prefetched;
 };
 
 MigrationIncomingState *migration_incoming_get_current(void);
@@ -345,6 +362,10 @@ int migrate_decompress_threads(void);
 bool migrate_use_events(void);
 bool migrate_postcopy_blocktime(void);
 bool migrate_background_snapshot(void);
+bool migrate_use_zero_copy_send(void);
+bool migrate_use_multifd_dedup(void);
+bool migrate_use_mapped_ram(void);
+bool migrate_postcopy_from_file(void);
 
 /* Sending on the return path - generic and then for each message type */
 void migrate_send_rp_shut(MigrationIncomingState *mis,
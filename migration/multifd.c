@@ -12,6 +12,10 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/bswap.h"
+#include "qemu/xxhash.h"
+#include "qemu/iov.h"
+#include "qemu/cutils.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
@@ -19,6 +23,7 @@
 #include "qapi/error.h"
 #include "ram.h"
 #include "migration.h"
+#include "file.h"
 #include "socket.h"
 #include "tls.h"
 #include "qemu-file.h"
@@ -94,7 +99,9 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
 /**
  * nocomp_send_write: do the actual write of the data
  *
- * For no compression we just have to write the data.
+ * For no compression we just have to write the data.  With zero copy
+ * send the pages are handed to the kernel directly from guest RAM;
+ * multifd_send_sync_main() waits for the kernel to release them.
  *
  * Returns 0 for success or -1 for error
  *
@@ -104,7 +111,14 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
  */
 static int nocomp_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
-    return qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+    int flags = 0;
+
+    if (migrate_use_zero_copy_send()) {
+        flags |= QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+    }
+
+    return qio_channel_writev_full_all(p->c, p->pages->iov, used, NULL, 0,
+                                       flags, errp);
 }
 
 /**
@@ -238,6 +252,203 @@ static int multifd_recv_initial_packet(QIOChannel *c, Error **errp)
     return msg.id;
 }
 
+/* Multifd dedup */
+
+/* Number of entries of the per channel dedup hash table */
+#define MULTIFD_DEDUP_TABLE_BITS 16
+#define MULTIFD_DEDUP_TABLE_SIZE (1 << MULTIFD_DEDUP_TABLE_BITS)
+
+/**
+ * multifd_dedup_hash: xxhash64 of a page
+ *
+ * @buf: the page contents
+ * @len: the page size, a multiple of 32
+ */
+static uint64_t multifd_dedup_hash(const uint8_t *buf, size_t len)
+{
+    uint64_t v1 = QEMU_XXHASH_SEED + XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = QEMU_XXHASH_SEED + XXH_PRIME64_2;
+    uint64_t v3 = QEMU_XXHASH_SEED + 0;
+    uint64_t v4 = QEMU_XXHASH_SEED - XXH_PRIME64_1;
+    size_t i;
+
+    for (i = 0; i < len; i += 32) {
+        v1 = XXH64_round(v1, ldq_le_p(buf + i));
+        v2 = XXH64_round(v2, ldq_le_p(buf + i + 8));
+        v3 = XXH64_round(v3, ldq_le_p(buf + i + 16));
+        v4 = XXH64_round(v4, ldq_le_p(buf + i + 24));
+    }
+
+    return XXH64_avalanche(XXH64_mergerounds(v1, v2, v3, v4) + len);
+}
+
+/**
+ * multifd_dedup_prepare: replace repeated pages with references
+ *
+ * Each page is first copied into the channel bounce buffer, so that the
+ * data that is hashed is exactly the data that is sent even if the guest
+ * keeps writing to it.  If a page with the same hash was already sent on
+ * this channel during the current round, and the page still has the
+ * same contents, only its offset is sent: the destination has received
+ * that earlier page on this same channel and, since a page is sent at
+ * most once per round, nobody overwrote it in the meantime.
+ *
+ * The iovs of the pages whose data must be sent are compacted at the
+ * beginning of p->pages->iov and point to the bounce buffer.
+ *
+ * Returns the number of pages whose data must be sent
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ */
+static uint32_t multifd_dedup_prepare(MultiFDSendParams *p, uint32_t used)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t i, data = 0;
+
+    for (i = 0; i < used; i++) {
+        uint8_t *buf = p->dedup_buf + data * page_size;
+        MultiFDDedupEntry *e;
+        uint64_t hash;
+
+        memcpy(buf, pages->iov[i].iov_base, page_size);
+        hash = multifd_dedup_hash(buf, page_size);
+        e = &p->dedup_table[hash & (MULTIFD_DEDUP_TABLE_SIZE - 1)];
+
+        if (e->round == p->dedup_round && e->hash == hash &&
+            e->block == pages->block &&
+            !memcmp(buf, pages->block->host + e->offset, page_size)) {
+            p->dedup_ref[i] = e->offset;
+            p->dedup_pages++;
+            continue;
+        }
+
+        e->hash = hash;
+        e->offset = pages->offset[i];
+        e->block = pages->block;
+        e->round = p->dedup_round;
+
+        p->dedup_ref[i] = MULTIFD_DEDUP_NONE;
+        pages->iov[data].iov_base = buf;
+        pages->iov[data].iov_len = page_size;
+        data++;
+    }
+
+    return data;
+}
+
+/**
+ * multifd_dedup_recv_copy: fill the pages that were sent as a reference
+ *
+ * Must be called once the data of the packet has been read, as a
+ * reference can point to a page of the same packet.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_dedup_recv_copy(MultiFDRecvParams *p)
+{
+    size_t page_size = qemu_target_page_size();
+    uint32_t i;
+
+    for (i = 0; i < p->dedup_copies; i++) {
+        memcpy(p->dedup_dst[i], p->dedup_src[i], page_size);
+    }
+}
+
+/*
+ * Write @niov pages at their position in the migration file.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int multifd_file_pwritev(MultiFDSendParams *p, struct iovec *iov,
+                                unsigned int niov, off_t pos, Error **errp)
+{
+    struct iovec *local_iov = g_new(struct iovec, niov);
+    struct iovec *local_iov_head = local_iov;
+    int ret = 0;
+
+    niov = iov_copy(local_iov, niov, iov, niov, 0, iov_size(iov, niov));
+    while (niov > 0) {
+        ssize_t len = qio_channel_pwritev(p->c, local_iov, niov, pos, errp);
+
+        if (len <= 0) {
+            if (len == 0) {
+                error_setg(errp, "Unable to write to migration file");
+            }
+            ret = -1;
+            break;
+        }
+        iov_discard_front(&local_iov, &niov, len);
+        pos += len;
+    }
+
+    g_free(local_iov_head);
+    return ret;
+}
+
+/*
+ * With mapped-ram, write the pages of the packet to their position in the
+ * migration file instead of sending a packet.  Runs of non-zero pages are
+ * written with a single call, zero pages are skipped and dropped from the
+ * file bitmap.  For background snapshots the write protection of the
+ * pages is released once they are in the file.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int multifd_file_write_pages(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = p->pages;
+    RAMBlock *block = pages->block;
+    size_t page_size = qemu_target_page_size();
+    int page_bits = qemu_target_page_bits();
+    uint32_t i, start, data;
+
+    for (start = 0; start < pages->used; start = i) {
+        /* run of pages contiguous in the RAMBlock */
+        for (i = start + 1; i < pages->used; i++) {
+            if (pages->offset[i] != pages->offset[i - 1] + page_size) {
+                break;
+            }
+        }
+
+        for (data = start; data < i; ) {
+            uint32_t end;
+
+            if (buffer_is_zero(pages->iov[data].iov_base, page_size)) {
+                clear_bit_atomic(pages->offset[data] >> page_bits,
+                                 block->file_bmap);
+                p->zero_pages++;
+                data++;
+                continue;
+            }
+            for (end = data + 1; end < i; end++) {
+                if (buffer_is_zero(pages->iov[end].iov_base, page_size)) {
+                    break;
+                }
+            }
+            if (multifd_file_pwritev(p, &pages->iov[data], end - data,
+                                     block->pages_offset +
+                                     pages->offset[data], errp) < 0) {
+                return -1;
+            }
+            for (; data < end; data++) {
+                set_bit_atomic(pages->offset[data] >> page_bits,
+                               block->file_bmap);
+            }
+        }
+
+        if (ram_write_tracking_release(block, pages->offset[start],
+                                       (i - start) * page_size) < 0) {
+            error_setg(errp, "Unable to release write protection of %s",
+                       block->idstr);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static MultiFDPages_t *multifd_pages_init(size_t size)
 {
     MultiFDPages_t *pages = g_new0(MultiFDPages_t, 1);
@@ -283,6 +494,71 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+
+    if (p->flags & MULTIFD_FLAG_DEDUP) {
+        uint64_t *ref = &packet->offset[p->pages->allocated];
+
+        for (i = 0; i < p->pages->used; i++) {
+            ref[i] = cpu_to_be64(p->dedup_ref[i]);
+        }
+    }
+}
+
+/*
+ * Same as the tail of multifd_recv_unfill_packet(), for packets with
+ * MULTIFD_FLAG_DEDUP: only the pages that carry data get an iov, the
+ * others are recorded as copies from an earlier page.
+ */
+static int multifd_recv_unfill_dedup(MultiFDRecvParams *p, RAMBlock *block,
+                                     Error **errp)
+{
+    MultiFDPacket_t *packet = p->packet;
+    uint64_t *ref = &packet->offset[packet->pages_alloc];
+    ram_addr_t max_offset = block->used_length - qemu_target_page_size();
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    int i;
+
+    if (!p->dedup_src) {
+        error_setg(errp, "multifd %d: received a dedup packet but "
+                   "multifd-dedup is not enabled", p->id);
+        return -1;
+    }
+    if (packet->pages_alloc != page_count) {
+        error_setg(errp, "multifd %d: dedup packet with %d pages, "
+                   "expected %d", p->id, packet->pages_alloc, page_count);
+        return -1;
+    }
+
+    p->dedup_data = 0;
+    p->dedup_copies = 0;
+    for (i = 0; i < p->pages->used; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[i]);
+        uint64_t src = be64_to_cpu(ref[i]);
+
+        if (offset > max_offset) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, block->max_length);
+            return -1;
+        }
+        if (src == MULTIFD_DEDUP_NONE) {
+            p->pages->iov[p->dedup_data].iov_base = block->host + offset;
+            p->pages->iov[p->dedup_data].iov_len = qemu_target_page_size();
+            p->dedup_data++;
+            continue;
+        }
+        if (src > max_offset) {
+            error_setg(errp, "multifd: dedup reference too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       src, block->max_length);
+            return -1;
+        }
+        p->dedup_src[p->dedup_copies] = block->host + src;
+        p->dedup_dst[p->dedup_copies] = block->host + offset;
+        p->dedup_copies++;
+    }
+
+    return 0;
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -354,6 +630,10 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    if (p->flags & MULTIFD_FLAG_DEDUP) {
+        return multifd_recv_unfill_dedup(p, block, errp);
+    }
+
     for (i = 0; i < p->pages->used; i++) {
         uint64_t offset = be64_to_cpu(packet->offset[i]);
 
@@ -458,6 +738,20 @@ static int multifd_send_pages(QEMUFile *f)
     return 1;
 }
 
+/*
+ * Send the pages queued so far, if any, without waiting for the packet
+ * to be full.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int multifd_send_flush(QEMUFile *f)
+{
+    if (!multifd_send_state->pages->used) {
+        return 0;
+    }
+    return multifd_send_pages(f) < 0 ? -1 : 0;
+}
+
 int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset)
 {
     MultiFDPages_t *pages = multifd_send_state->pages;
@@ -559,6 +853,12 @@ void multifd_save_cleanup(void)
         p->packet_len = 0;
         g_free(p->packet);
         p->packet = NULL;
+        g_free(p->dedup_table);
+        p->dedup_table = NULL;
+        qemu_vfree(p->dedup_buf);
+        p->dedup_buf = NULL;
+        g_free(p->dedup_ref);
+        p->dedup_ref = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
@@ -574,17 +874,17 @@ void multifd_save_cleanup(void)
     multifd_send_state = NULL;
 }
 
-void multifd_send_sync_main(QEMUFile *f)
+int multifd_send_sync_main(QEMUFile *f)
 {
     int i;
 
     if (!migrate_use_multifd()) {
-        return;
+        return 0;
     }
     if (multifd_send_state->pages->used) {
         if (multifd_send_pages(f) < 0) {
             error_report("%s: multifd_send_pages fail", __func__);
-            return;
+            return -1;
         }
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -597,7 +897,7 @@ void multifd_send_sync_main(QEMUFile *f)
         if (p->quit) {
             error_report("%s: channel %d has already quit", __func__, i);
             qemu_mutex_unlock(&p->mutex);
-            return;
+            return -1;
         }
 
         p->packet_num = multifd_send_state->packet_num++;
@@ -614,8 +914,63 @@ void multifd_send_sync_main(QEMUFile *f)
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        if (p->dedup_table) {
+            uint64_t saved;
+
+            qemu_mutex_lock(&p->mutex);
+            saved = p->dedup_pages * qemu_target_page_size();
+            ram_counters.dedup_pages += p->dedup_pages;
+            p->dedup_pages = 0;
+            qemu_mutex_unlock(&p->mutex);
+
+            /* multifd_send_pages() accounted for the full pages */
+            ram_counters.dedup_bytes += saved;
+            ram_counters.multifd_bytes -= saved;
+            ram_counters.transferred -= saved;
+        }
+
+        if (migrate_use_mapped_ram()) {
+            uint64_t zero_pages, saved;
+
+            qemu_mutex_lock(&p->mutex);
+            zero_pages = p->zero_pages;
+            p->zero_pages = 0;
+            qemu_mutex_unlock(&p->mutex);
+
+            /* multifd_send_pages() accounted for them as normal pages */
+            saved = zero_pages * qemu_target_page_size();
+            ram_counters.normal -= zero_pages;
+            ram_counters.duplicate += zero_pages;
+            ram_counters.multifd_bytes -= saved;
+            ram_counters.transferred -= saved;
+        }
+
+        /*
+         * With zero copy send, pages queued in this round may still be
+         * referenced by the kernel.  Wait until they have been sent so that
+         * the next round starts from a clean state.  The channel thread is
+         * idle at this point, so it is safe to flush from here.
+         */
+        if (migrate_use_zero_copy_send()) {
+            Error *err = NULL;
+            int ret = qio_channel_flush(p->c, &err);
+
+            if (ret < 0) {
+                migrate_set_error(migrate_get_current(), err);
+                error_free(err);
+                qemu_file_set_error(f, -EIO);
+                return -1;
+            }
+            if (ret == 1) {
+                /* Sent, but the kernel had to copy the pages after all */
+                ram_counters.dirty_sync_missed_zero_copy++;
+            }
+        }
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
+
+    return 0;
 }
 
 static void *multifd_send_thread(void *opaque)
@@ -628,12 +983,15 @@ static void *multifd_send_thread(void *opaque)
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
-    if (multifd_send_initial_packet(p, &local_err) < 0) {
-        ret = -1;
-        goto out;
+    /* With mapped-ram there is nobody to read packets */
+    if (!migrate_use_mapped_ram()) {
+        if (multifd_send_initial_packet(p, &local_err) < 0) {
+            ret = -1;
+            goto out;
+        }
+        /* initial packet */
+        p->num_packets = 1;
     }
-    /* initial packet */
-    p->num_packets = 1;
 
     while (true) {
         qemu_sem_wait(&p->sem);
@@ -643,13 +1001,53 @@ static void *multifd_send_thread(void *opaque)
         }
         qemu_mutex_lock(&p->mutex);
 
-        if (p->pending_job) {
+        if (p->pending_job && migrate_use_mapped_ram()) {
             uint32_t used = p->pages->used;
             uint64_t packet_num = p->packet_num;
+
             flags = p->flags;
+            p->flags = 0;
+            qemu_mutex_unlock(&p->mutex);
+
+            trace_multifd_send(p->id, packet_num, used, flags, 0);
 
+            /*
+             * The pages are only handed back to the migration thread
+             * below, so they can be used without holding the mutex.
+             */
             if (used) {
-                ret = multifd_send_state->ops->send_prepare(p, used,
+                ret = multifd_file_write_pages(p, &local_err);
+                if (ret != 0) {
+                    break;
+                }
+            }
+
+            qemu_mutex_lock(&p->mutex);
+            p->num_packets++;
+            p->num_pages += used;
+            p->pages->used = 0;
+            p->pages->block = NULL;
+            p->pending_job--;
+            qemu_mutex_unlock(&p->mutex);
+
+            if (flags & MULTIFD_FLAG_SYNC) {
+                qemu_sem_post(&p->sem_sync);
+            }
+            qemu_sem_post(&multifd_send_state->channels_ready);
+        } else if (p->pending_job) {
+            uint32_t used = p->pages->used;
+            uint32_t data = used;
+            uint64_t packet_num = p->packet_num;
+
+            if (used && p->dedup_table) {
+                data = multifd_dedup_prepare(p, used);
+                p->flags |= MULTIFD_FLAG_DEDUP;
+                p->next_packet_size = 0;
+            }
+            flags = p->flags;
+
+            if (data) {
+                ret = multifd_send_state->ops->send_prepare(p, data,
                                                             &local_err);
                 if (ret != 0) {
                     qemu_mutex_unlock(&p->mutex);
@@ -673,8 +1071,8 @@ static void *multifd_send_thread(void *opaque)
                 break;
             }
 
-            if (used) {
-                ret = multifd_send_state->ops->send_write(p, used, &local_err);
+            if (data) {
+                ret = multifd_send_state->ops->send_write(p, data, &local_err);
                 if (ret != 0) {
                     break;
                 }
@@ -685,6 +1083,11 @@ static void *multifd_send_thread(void *opaque)
             qemu_mutex_unlock(&p->mutex);
 
             if (flags & MULTIFD_FLAG_SYNC) {
+                /*
+                 * Pages sent after a sync can be dirty again, start over
+                 * with an empty dedup table.
+                 */
+                p->dedup_round++;
                 qemu_sem_post(&p->sem_sync);
             }
             qemu_sem_post(&multifd_send_state->channels_ready);
@@ -841,6 +1244,13 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
     if (qio_task_propagate_error(task, &local_err)) {
         goto cleanup;
     } else {
+        if (migrate_use_zero_copy_send() &&
+            !qio_channel_has_feature(sioc,
+                                     QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+            error_setg(&local_err, "Zero copy send is not supported by "
+                       "the host for this migration channel");
+            goto cleanup;
+        }
         p->c = QIO_CHANNEL(sioc);
         qio_channel_set_delay(p->c, false);
         p->running = true;
@@ -865,6 +1275,25 @@ int multifd_save_setup(Error **errp)
         return 0;
     }
     s = migrate_get_current();
+    if (migrate_use_zero_copy_send() &&
+        (migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE ||
+         (s->parameters.tls_creds && *s->parameters.tls_creds))) {
+        error_setg(errp, "Zero copy send is only available for "
+                   "non-compressed non-TLS multifd migration");
+        return -1;
+    }
+    if (migrate_use_multifd_dedup() &&
+        migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+        error_setg(errp, "Multifd dedup is only available for "
+                   "non-compressed multifd migration");
+        return -1;
+    }
+    if (migrate_use_mapped_ram() &&
+        migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+        error_setg(errp, "Mapped-ram is only available for "
+                   "non-compressed multifd migration");
+        return -1;
+    }
     thread_count = migrate_multifd_channels();
     multifd_send_state = g_malloc0(sizeof(*multifd_send_state));
     multifd_send_state->params = g_new0(MultiFDSendParams, thread_count);
@@ -883,13 +1312,33 @@ int multifd_save_setup(Error **errp)
         p->pending_job = 0;
         p->id = i;
         p->pages = multifd_pages_init(page_count);
+        p->name = g_strdup_printf("multifdsend_%d", i);
+        p->tls_hostname = g_strdup(s->hostname);
+        if (migrate_use_mapped_ram()) {
+            Error *local_err = NULL;
+
+            /* No packets, the pages go straight to the file */
+            if (!file_send_channel_create(multifd_new_send_channel_async, p,
+                                          &local_err)) {
+                multifd_new_send_channel_cleanup(p, NULL, local_err);
+            }
+            continue;
+        }
         p->packet_len = sizeof(MultiFDPacket_t)
                       + sizeof(uint64_t) * page_count;
+        if (migrate_use_multifd_dedup()) {
+            p->packet_len += sizeof(uint64_t) * page_count;
+            p->dedup_table = g_new0(MultiFDDedupEntry,
+                                    MULTIFD_DEDUP_TABLE_SIZE);
+            /* round 0 marks the unused entries */
+            p->dedup_round = 1;
+            p->dedup_buf = qemu_memalign(qemu_real_host_page_size,
+                                         MULTIFD_PACKET_SIZE);
+            p->dedup_ref = g_new0(uint64_t, page_count);
+        }
         p->packet = g_malloc0(p->packet_len);
         p->packet->magic = cpu_to_be32(MULTIFD_MAGIC);
         p->packet->version = cpu_to_be32(MULTIFD_VERSION);
-        p->name = g_strdup_printf("multifdsend_%d", i);
-        p->tls_hostname = g_strdup(s->hostname);
         socket_send_channel_create(multifd_new_send_channel_async, p);
     }
 
@@ -957,7 +1406,7 @@ int multifd_load_cleanup(Error **errp)
 {
     int i;
 
-    if (!migrate_use_multifd()) {
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return 0;
     }
     multifd_recv_terminate_threads(NULL);
@@ -995,6 +1444,10 @@ int multifd_load_cleanup(Error **errp)
         p->packet_len = 0;
         g_free(p->packet);
         p->packet = NULL;
+        g_free(p->dedup_src);
+        p->dedup_src = NULL;
+        g_free(p->dedup_dst);
+        p->dedup_dst = NULL;
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
@@ -1010,7 +1463,7 @@ void multifd_recv_sync_main(void)
 {
     int i;
 
-    if (!migrate_use_multifd()) {
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return;
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -1044,6 +1497,7 @@ static void *multifd_recv_thread(void *opaque)
 
     while (true) {
         uint32_t used;
+        uint32_t data;
         uint32_t flags;
 
         if (p->quit) {
@@ -1068,21 +1522,26 @@ static void *multifd_recv_thread(void *opaque)
 
         used = p->pages->used;
         flags = p->flags;
-        /* recv methods don't know how to handle the SYNC flag */
-        p->flags &= ~MULTIFD_FLAG_SYNC;
+        data = (flags & MULTIFD_FLAG_DEDUP) ? p->dedup_data : used;
+        /* recv methods don't know how to handle the SYNC and DEDUP flags */
+        p->flags &= ~(MULTIFD_FLAG_SYNC | MULTIFD_FLAG_DEDUP);
         trace_multifd_recv(p->id, p->packet_num, used, flags,
                            p->next_packet_size);
         p->num_packets++;
         p->num_pages += used;
         qemu_mutex_unlock(&p->mutex);
 
-        if (used) {
-            ret = multifd_recv_state->ops->recv_pages(p, used, &local_err);
+        if (data) {
+            ret = multifd_recv_state->ops->recv_pages(p, data, &local_err);
             if (ret != 0) {
                 break;
             }
         }
 
+        if (flags & MULTIFD_FLAG_DEDUP) {
+            multifd_dedup_recv_copy(p);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1109,7 +1568,8 @@ int multifd_load_setup(Error **errp)
     uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
     uint8_t i;
 
-    if (!migrate_use_multifd()) {
+    /* With mapped-ram the pages are read from the main channel */
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return 0;
     }
     thread_count = migrate_multifd_channels();
@@ -1129,6 +1589,11 @@ int multifd_load_setup(Error **errp)
         p->pages = multifd_pages_init(page_count);
         p->packet_len = sizeof(MultiFDPacket_t)
                       + sizeof(uint64_t) * page_count;
+        if (migrate_use_multifd_dedup()) {
+            p->packet_len += sizeof(uint64_t) * page_count;
+            p->dedup_src = g_new0(void *, page_count);
+            p->dedup_dst = g_new0(void *, page_count);
+        }
         p->packet = g_malloc0(p->packet_len);
         p->name = g_strdup_printf("multifdrecv_%d", i);
     }
@@ -1151,7 +1616,7 @@ bool multifd_recv_all_channels_created(void)
 {
     int thread_count = migrate_multifd_channels();
 
-    if (!migrate_use_multifd()) {
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return true;
     }
 
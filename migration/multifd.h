@@ -20,8 +20,9 @@ int multifd_load_cleanup(Error **errp);
 bool multifd_recv_all_channels_created(void);
 bool multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
-void multifd_send_sync_main(QEMUFile *f);
+int multifd_send_sync_main(QEMUFile *f);
 int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
+int multifd_send_flush(QEMUFile *f);
 
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
@@ -33,6 +34,12 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
 
+/* The packet carries a dedup reference for each page */
+#define MULTIFD_FLAG_DEDUP (1 << 4)
+
+/* Dedup reference of a page whose data is sent in the packet */
+#define MULTIFD_DEDUP_NONE UINT64_MAX
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
@@ -48,6 +55,10 @@ typedef struct {
     uint64_t packet_num;
     uint64_t unused[4];    /* Reserved for future use */
     char ramblock[256];
+    /*
+     * pages_alloc page offsets; with MULTIFD_FLAG_DEDUP they are followed
+     * by pages_alloc dedup references (see MULTIFD_DEDUP_NONE)
+     */
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
 
@@ -65,6 +76,16 @@ typedef struct {
     RAMBlock *block;
 } MultiFDPages_t;
 
+typedef struct {
+    /* content hash of the page */
+    uint64_t hash;
+    /* offset of the page inside @block */
+    ram_addr_t offset;
+    RAMBlock *block;
+    /* entry is only valid if it matches the channel dedup_round */
+    uint32_t round;
+} MultiFDDedupEntry;
+
 typedef struct {
     /* this fields are not changed once the thread is created */
     /* channel number */
@@ -108,6 +129,18 @@ typedef struct {
     QemuSemaphore sem_sync;
     /* used for compression methods */
     void *data;
+    /* dedup hash table, NULL if dedup is disabled */
+    MultiFDDedupEntry *dedup_table;
+    /* current dedup round, bumped after each sync */
+    uint32_t dedup_round;
+    /* snapshot of the pages being sent, what was hashed is what is sent */
+    uint8_t *dedup_buf;
+    /* dedup reference of each page */
+    uint64_t *dedup_ref;
+    /* pages sent as a reference, not yet accounted in ram_counters */
+    uint64_t dedup_pages;
+    /* zero pages skipped with mapped-ram, not yet accounted in ram_counters */
+    uint64_t zero_pages;
 }  MultiFDSendParams;
 
 typedef struct {
@@ -147,6 +180,13 @@ typedef struct {
     QemuSemaphore sem_sync;
     /* used for de-compression methods */
     void *data;
+    /* number of pages of the packet whose data is in the stream */
+    uint32_t dedup_data;
+    /* number of pages of the packet to copy from an earlier page */
+    uint32_t dedup_copies;
+    /* source and destination of each copy */
+    void **dedup_src;
+    void **dedup_dst;
 } MultiFDRecvParams;
 
 typedef struct {
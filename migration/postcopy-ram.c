@@ -23,6 +23,7 @@
 #include "savevm.h"
 #include "postcopy-ram.h"
 #include "ram.h"
+#include "file.h"
 #include "qapi/error.h"
 #include "qemu/notify.h"
 #include "qemu/rcu.h"
@@ -842,6 +843,56 @@ static bool postcopy_pause_fault_thread(MigrationIncomingState *mis)
     return true;
 }
 
+/*
+ * postcopy-from-file: place the host page at @offset of @rb, reading it
+ * from the mapped-ram file, unless it is already there.  Called by both the
+ * fault thread and the prefetch thread, each with its own @buf of the
+ * largest page size.
+ * returns 0 on success
+ */
+static int postcopy_file_place_page(MigrationIncomingState *mis,
+                                    RAMBlock *rb, ram_addr_t offset,
+                                    void *buf, bool fault)
+{
+    void *host = qemu_ram_get_host_addr(rb) + offset;
+    int ret;
+
+    if (ramblock_recv_bitmap_test_byte_offset(rb, offset)) {
+        return 0;
+    }
+
+    ret = mapped_ram_read_page(mis->postcopy_file_ioc, rb, offset, buf);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /*
+     * Both threads may have read the same page; only the first one places
+     * it, since UFFDIO_COPY on a page that is present fails.
+     */
+    qemu_mutex_lock(&mis->postcopy_file_mutex);
+    if (ramblock_recv_bitmap_test_byte_offset(rb, offset)) {
+        ret = 0;
+    } else {
+        if (ret) {
+            ret = postcopy_place_page_zero(mis, host, rb);
+        } else {
+            ret = postcopy_place_page(mis, host, buf, rb);
+        }
+        if (!ret) {
+            if (fault) {
+                mis->postcopy_file_faults++;
+            } else {
+                mis->postcopy_file_prefetched++;
+            }
+        }
+    }
+    qemu_mutex_unlock(&mis->postcopy_file_mutex);
+
+    trace_postcopy_file_place_page(qemu_ram_get_idstr(rb), offset, fault);
+    return ret;
+}
+
 /*
  * Handle faults detected by the USERFAULT markings
  */
@@ -893,7 +944,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
             break;
         }
 
-        if (!mis->to_src_file) {
+        if (!mis->to_src_file && !mis->postcopy_file_ioc) {
             /*
              * Possibly someone tells us that the return path is
              * broken already using the event. We should hold until
@@ -970,6 +1021,18 @@ static void *postcopy_ram_fault_thread(void *opaque)
                     (uintptr_t)(msg.arg.pagefault.address),
                                 msg.arg.pagefault.feat.ptid, rb);
 
+            if (mis->postcopy_file_ioc) {
+                /* No source to ask, read the page from the file ourselves */
+                ret = postcopy_file_place_page(mis, rb, rb_offset,
+                                               mis->postcopy_tmp_page, true);
+                if (ret) {
+                    error_report("%s: postcopy_file_place_page() get %d",
+                                 __func__, ret);
+                    break;
+                }
+                continue;
+            }
+
 retry:
             /*
              * Send the request to the source - we want to request one
@@ -1124,6 +1187,119 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     return 0;
 }
 
+static int postcopy_file_prefetch_block(RAMBlock *rb, void *opaque)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t length = qemu_ram_get_used_length(rb);
+    ram_addr_t offset;
+    int ret;
+
+    for (offset = 0; offset < length; offset += pagesize) {
+        ret = postcopy_file_place_page(mis, rb, offset, opaque, false);
+        if (ret) {
+            error_report("%s: failed to load %s at 0x" RAM_ADDR_FMT ": %d",
+                         __func__, qemu_ram_get_idstr(rb), offset, ret);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Walk all of RAM to load the pages that the guest did not fault in, then
+ * finish the migration the way the postcopy listen thread does.
+ */
+static void *postcopy_file_prefetch_thread(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+    void *buf;
+    int ret;
+
+    rcu_register_thread();
+    trace_postcopy_file_prefetch_thread_start();
+
+    buf = qemu_memalign(qemu_real_host_page_size, mis->largest_page_size);
+    ret = foreach_not_ignored_block(postcopy_file_prefetch_block, buf);
+    qemu_vfree(buf);
+    if (ret) {
+        Error *local_err = NULL;
+
+        error_setg(&local_err, "postcopy-from-file: failed to load RAM "
+                   "from the migration file: %d", ret);
+        migrate_set_error(migrate_get_current(), local_err);
+        error_free(local_err);
+        /* Fail the incoming coroutine if it is still loading the devices */
+        qemu_file_set_error(mis->from_src_file, ret < 0 ? ret : -EIO);
+    }
+
+    /* Wait for the main thread to start the guest */
+    qemu_sem_wait(&mis->prefetch_run_sem);
+    trace_postcopy_file_prefetch_thread_exit(mis->postcopy_file_faults,
+                                             mis->postcopy_file_prefetched);
+
+    if (ret) {
+        /*
+         * The guest is running already and there is nowhere else to get
+         * the missing pages from; leave them missing and let management
+         * see the failure.
+         */
+        migrate_set_state(&mis->state, MIGRATION_STATUS_POSTCOPY_ACTIVE,
+                                       MIGRATION_STATUS_FAILED);
+        rcu_unregister_thread();
+        return NULL;
+    }
+
+    postcopy_ram_incoming_cleanup(mis);
+    object_unref(OBJECT(mis->postcopy_file_ioc));
+    mis->postcopy_file_ioc = NULL;
+    ram_load_bitmaps_cleanup();
+    mis->have_prefetch_thread = false;
+
+    migrate_set_state(&mis->state, MIGRATION_STATUS_POSTCOPY_ACTIVE,
+                                   MIGRATION_STATUS_COMPLETED);
+    migration_incoming_state_destroy();
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+int postcopy_file_incoming_setup(MigrationIncomingState *mis)
+{
+    Error *local_err = NULL;
+
+    /* Must be there before the fault thread starts */
+    mis->postcopy_file_ioc = file_incoming_channel_create(&local_err);
+    if (!mis->postcopy_file_ioc) {
+        error_report_err(local_err);
+        return -1;
+    }
+    mis->postcopy_file_faults = 0;
+    mis->postcopy_file_prefetched = 0;
+
+    /*
+     * As for postcopy, all of RAM must be missing for the faults to be
+     * reported, and must stay missing until a page is placed.
+     */
+    if (foreach_not_ignored_block(nhp_range, mis) ||
+        postcopy_ram_incoming_init(mis) ||
+        postcopy_ram_incoming_setup(mis)) {
+        postcopy_ram_incoming_cleanup(mis);
+        object_unref(OBJECT(mis->postcopy_file_ioc));
+        mis->postcopy_file_ioc = NULL;
+        return -1;
+    }
+
+    mis->have_prefetch_thread = true;
+    qemu_thread_create(&mis->prefetch_thread, "postcopy/prefetch",
+                       postcopy_file_prefetch_thread, mis,
+                       QEMU_THREAD_DETACHED);
+    trace_postcopy_file_incoming_setup();
+
+    return 0;
+}
+
 static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
                                void *from_addr, uint64_t pagesize, RAMBlock *rb)
 {
@@ -1278,6 +1454,12 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     return -1;
 }
 
+int postcopy_file_incoming_setup(MigrationIncomingState *mis)
+{
+    error_report("%s: No OS support", __func__);
+    return -1;
+}
+
 int postcopy_place_page(MigrationIncomingState *mis, void *host, void *from,
                         RAMBlock *rb)
 {
@@ -22,6 +22,13 @@ bool postcopy_ram_supported_by_host(MigrationIncomingState *mis);
  */
 int postcopy_ram_incoming_setup(MigrationIncomingState *mis);
 
+/*
+ * postcopy-from-file: once the RAMBlocks of a mapped-ram file are known,
+ * serve the accesses to RAM from the file and start loading it in the
+ * background.
+ */
+int postcopy_file_incoming_setup(MigrationIncomingState *mis);
+
 /*
  * Initialise postcopy-ram, setting the RAM to a state where we can go into
  * postcopy later; must be called prior to any precopy.
@@ -153,6 +153,44 @@ static int channel_set_blocking(void *opaque,
     return 0;
 }
 
+static off_t channel_seek(void *opaque,
+                          off_t offset,
+                          int whence,
+                          Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+
+    return qio_channel_io_seek(ioc, offset, whence, errp);
+}
+
+
+static ssize_t channel_pwritev_buffer(void *opaque,
+                                      const struct iovec *iov,
+                                      int iovcnt,
+                                      off_t pos,
+                                      Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    ssize_t ret;
+
+    ret = qio_channel_pwritev(ioc, iov, iovcnt, pos, errp);
+    return ret < 0 ? -EIO : ret;
+}
+
+
+static ssize_t channel_preadv_buffer(void *opaque,
+                                     const struct iovec *iov,
+                                     int iovcnt,
+                                     off_t pos,
+                                     Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    ssize_t ret;
+
+    ret = qio_channel_preadv(ioc, iov, iovcnt, pos, errp);
+    return ret < 0 ? -EIO : ret;
+}
+
 static QEMUFile *channel_get_input_return_path(void *opaque)
 {
     QIOChannel *ioc = QIO_CHANNEL(opaque);
@@ -173,6 +211,8 @@ static const QEMUFileOps channel_input_ops = {
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
     .get_return_path = channel_get_input_return_path,
+    .seek = channel_seek,
+    .preadv_buffer = channel_preadv_buffer,
 };
 
 
@@ -182,6 +222,8 @@ static const QEMUFileOps channel_output_ops = {
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
     .get_return_path = channel_get_output_return_path,
+    .seek = channel_seek,
+    .pwritev_buffer = channel_pwritev_buffer,
 };
 
 
@@ -846,3 +846,145 @@ void qemu_file_set_blocking(QEMUFile *f, bool block)
         f->ops->set_blocking(f->opaque, block, NULL);
     }
 }
+
+/*
+ * Return the position in the underlying file of the next byte of the
+ * stream.  Only files backed by something seekable support this; -1 is
+ * returned and an error is set on the file otherwise.
+ */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    Error *local_error = NULL;
+    off_t ret;
+
+    if (!f->ops->seek) {
+        qemu_file_set_error(f, -ENOTSUP);
+        return -1;
+    }
+
+    qemu_fflush(f);
+    ret = f->ops->seek(f->opaque, 0, SEEK_CUR, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -1;
+    }
+
+    /* Data that was read ahead is still pending in the buffer */
+    return ret - (f->buf_size - f->buf_index);
+}
+
+/*
+ * Continue the stream at @offset of the underlying file.  The logical
+ * position reported by qemu_ftell() is not affected, so skipped ranges
+ * are not accounted as transferred.
+ *
+ * Returns 0 on success, negative errno value on failure.
+ */
+int qemu_set_offset(QEMUFile *f, off_t offset)
+{
+    Error *local_error = NULL;
+
+    if (!f->ops->seek) {
+        qemu_file_set_error(f, -ENOTSUP);
+        return -ENOTSUP;
+    }
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        /* Drop what was read ahead, it belongs to the old position */
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    if (f->ops->seek(f->opaque, offset, SEEK_SET, &local_error) < 0) {
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/*
+ * Write @buf at position @pos of the underlying file, out of band of the
+ * stream: neither the buffered data nor the file position are touched.
+ * The data is accounted as transferred.
+ *
+ * Returns the number of bytes written, which is less than @size on error.
+ */
+size_t qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t size,
+                          off_t pos)
+{
+    Error *local_error = NULL;
+    size_t done = 0;
+
+    if (f->last_error) {
+        return 0;
+    }
+    if (!f->ops->pwritev_buffer) {
+        qemu_file_set_error(f, -ENOTSUP);
+        return 0;
+    }
+
+    while (done < size) {
+        struct iovec iov = {
+            .iov_base = (void *)(buf + done),
+            .iov_len = size - done,
+        };
+        ssize_t ret;
+
+        ret = f->ops->pwritev_buffer(f->opaque, &iov, 1, pos + done,
+                                     &local_error);
+        if (ret <= 0) {
+            qemu_file_set_error_obj(f, ret < 0 ? ret : -EIO, local_error);
+            break;
+        }
+        done += ret;
+    }
+
+    f->pos += done;
+    f->bytes_xfer += done;
+    return done;
+}
+
+/*
+ * Read @size bytes at position @pos of the underlying file into @buf, out
+ * of band of the stream.
+ *
+ * Returns the number of bytes read, which is less than @size on error or
+ * at the end of the file.
+ */
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t size, off_t pos)
+{
+    Error *local_error = NULL;
+    size_t done = 0;
+
+    if (f->last_error) {
+        return 0;
+    }
+    if (!f->ops->preadv_buffer) {
+        qemu_file_set_error(f, -ENOTSUP);
+        return 0;
+    }
+
+    while (done < size) {
+        struct iovec iov = {
+            .iov_base = buf + done,
+            .iov_len = size - done,
+        };
+        ssize_t ret;
+
+        ret = f->ops->preadv_buffer(f->opaque, &iov, 1, pos + done,
+                                    &local_error);
+        if (ret < 0) {
+            qemu_file_set_error_obj(f, ret, local_error);
+            break;
+        }
+        if (ret == 0) {
+            qemu_file_set_error(f, -EIO);
+            break;
+        }
+        done += ret;
+    }
+
+    return done;
+}
@@ -61,6 +61,23 @@ typedef ssize_t (QEMUFileWritevBufferFunc)(void *opaque, struct iovec *iov,
                                            int iovcnt, int64_t pos,
                                            Error **errp);
 
+/*
+ * Move the position of the underlying file, as lseek() does.  Returns the
+ * new position, or -1 if the file does not support random access.
+ */
+typedef off_t (QEMUFileSeekFunc)(void *opaque, off_t offset, int whence,
+                                 Error **errp);
+
+/*
+ * Write or read an iovec at the given position of the underlying file,
+ * without moving its current position.  Returns the number of bytes
+ * transferred, which may be short, or a negative errno value.
+ */
+typedef ssize_t (QEMUFilePositionedIOFunc)(void *opaque,
+                                           const struct iovec *iov,
+                                           int iovcnt, off_t pos,
+                                           Error **errp);
+
 /*
  * This function provides hooks around different
  * stages of RAM migration.
@@ -110,6 +127,9 @@ typedef struct QEMUFileOps {
     QEMUFileWritevBufferFunc *writev_buffer;
     QEMURetPathFunc *get_return_path;
     QEMUFileShutdownFunc *shut_down;
+    QEMUFileSeekFunc *seek;
+    QEMUFilePositionedIOFunc *pwritev_buffer;
+    QEMUFilePositionedIOFunc *preadv_buffer;
 } QEMUFileOps;
 
 typedef struct QEMUFileHooks {
@@ -161,6 +181,11 @@ int qemu_file_shutdown(QEMUFile *f);
 QEMUFile *qemu_file_get_return_path(QEMUFile *f);
 void qemu_fflush(QEMUFile *f);
 void qemu_file_set_blocking(QEMUFile *f, bool block);
+off_t qemu_get_offset(QEMUFile *f);
+int qemu_set_offset(QEMUFile *f, off_t offset);
+size_t qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t size,
+                          off_t pos);
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t size, off_t pos);
 
 void ram_control_before_iterate(QEMUFile *f, uint64_t flags);
 void ram_control_after_iterate(QEMUFile *f, uint64_t flags);
@@ -29,6 +29,7 @@
 #include "qemu/osdep.h"
 #include "cpu.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
@@ -81,6 +82,12 @@
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
 
+/*
+ * With mapped-ram, the pages of each RAMBlock start at a position of the
+ * migration file aligned to this size, so that they can be mapped.
+ */
+#define MAPPED_RAM_PAGES_ALIGN (1 * MiB)
+
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
 {
     return buffer_is_zero(p, size);
@@ -1210,6 +1217,46 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss, bool last_stage)
     return pages;
 }
 
+/* Size in the migration file of the mapped-ram bitmap of a RAMBlock */
+static size_t mapped_ram_bitmap_size(ram_addr_t length)
+{
+    return DIV_ROUND_UP(length >> TARGET_PAGE_BITS, 64) * sizeof(uint64_t);
+}
+
+/**
+ * ram_save_file_page: write the given page at its position in the file
+ *
+ * Zero pages are not written: the destination RAM starts zeroed, so it
+ * is enough to drop them from the bitmap, in case an earlier version of
+ * the page was written.
+ *
+ * Returns the number of pages written, or negative on error.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int ram_save_file_page(RAMState *rs, RAMBlock *block,
+                              ram_addr_t offset)
+{
+    uint8_t *p = block->host + offset;
+
+    if (is_zero_range(p, TARGET_PAGE_SIZE)) {
+        clear_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
+        ram_counters.duplicate++;
+        return 1;
+    }
+
+    if (qemu_put_buffer_at(rs->f, p, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset) != TARGET_PAGE_SIZE) {
+        return -1;
+    }
+    set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
+    ram_counters.transferred += TARGET_PAGE_SIZE;
+    ram_counters.normal++;
+    return 1;
+}
+
 static int ram_save_multifd_page(RAMState *rs, RAMBlock *block,
                                  ram_addr_t offset)
 {
@@ -1489,6 +1536,14 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
 {
     int res = 0;
 
+    /*
+     * With mapped-ram the multifd channels release the protection once
+     * they have written the pages to the file.
+     */
+    if (migrate_use_mapped_ram() && migrate_use_multifd()) {
+        return 0;
+    }
+
     /* Check if page is from UFFD-managed region. */
     if (pss->block->flags & RAM_UF_WRITEPROTECT) {
         void *page_address = pss->block->host + (start_page << TARGET_PAGE_BITS);
@@ -1504,6 +1559,28 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
     return res;
 }
 
+/**
+ * ram_write_tracking_release: release UFFD write protection of a range of
+ *   pages once they have been saved outside of the migration thread
+ *
+ * @rb: RAMBlock that contains the pages
+ * @start: offset of the first page inside @rb
+ * @length: length of the range
+ *
+ * Returns 0 on success, negative value in case of an error
+ */
+int ram_write_tracking_release(RAMBlock *rb, ram_addr_t start,
+                               ram_addr_t length)
+{
+    RAMState *rs = qatomic_read(&ram_state);
+
+    if (!rs || !(rb->flags & RAM_UF_WRITEPROTECT)) {
+        return 0;
+    }
+    return uffd_change_protection(rs->uffdio_fd, rb->host + start, length,
+                                  false, false);
+}
+
 /* ram_write_tracking_available: check if kernel supports required UFFD features
  *
  * Returns true if supports, false otherwise
@@ -1681,6 +1758,16 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
     return 0;
 }
 
+int ram_write_tracking_release(RAMBlock *rb, ram_addr_t start,
+                               ram_addr_t length)
+{
+    (void) rb;
+    (void) start;
+    (void) length;
+
+    return 0;
+}
+
 bool ram_write_tracking_available(void)
 {
     return false;
@@ -1941,6 +2028,17 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return 1;
     }
 
+    /*
+     * With mapped-ram, zero pages are detected where the page is written,
+     * by the multifd channels if any.
+     */
+    if (migrate_use_mapped_ram()) {
+        if (migrate_use_multifd()) {
+            return ram_save_multifd_page(rs, block, offset);
+        }
+        return ram_save_file_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -2046,7 +2144,7 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
 {
     PageSearchStatus pss;
     int pages = 0;
-    bool again, found;
+    bool again, found, queued;
 
     /* No dirty page as there is zero RAM */
     if (!ram_bytes_total()) {
@@ -2063,7 +2161,7 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
 
     do {
         again = true;
-        found = get_queued_page(rs, &pss);
+        found = queued = get_queued_page(rs, &pss);
 
         if (!found) {
             /* priority queue empty, so just search for something dirty */
@@ -2072,6 +2170,14 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
 
         if (found) {
             pages = ram_save_host_page(rs, &pss, last_stage);
+            /*
+             * A vCPU waits for a write-protected page until a multifd
+             * channel has written it, don't let it sit in a partial packet.
+             */
+            if (queued && pages > 0 && migrate_background_snapshot() &&
+                migrate_use_multifd() && multifd_send_flush(rs->f) < 0) {
+                pages = -1;
+            }
         }
     } while (!pages && again);
 
@@ -2176,6 +2282,11 @@ static void ram_save_cleanup(void *opaque)
         block->bmap = NULL;
     }
 
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
+    }
+
     xbzrle_cleanup();
     compress_threads_save_cleanup();
     ram_state_cleanup(rsp);
@@ -2735,6 +2846,74 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
     }
 }
 
+/**
+ * mapped_ram_save_block_header: reserve room for a RAMBlock in the file
+ *
+ * The pages of the block are stored at a fixed position of the migration
+ * file, after the bitmap of the pages that are present.  Both are written
+ * out of band of the stream, which continues after them.
+ *
+ * Returns 0 for success or negative value on error
+ *
+ * @f: QEMUFile where to send the data
+ * @block: RAMBlock whose header is being written
+ */
+static int mapped_ram_save_block_header(QEMUFile *f, RAMBlock *block)
+{
+    unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+    off_t header_end;
+
+    header_end = qemu_get_offset(f);
+    if (header_end < 0) {
+        error_report("mapped-ram requires a seekable migration file");
+        return -1;
+    }
+    header_end += 2 * sizeof(uint64_t);
+
+    block->file_bmap = bitmap_new(ROUND_UP(pages, 64));
+    block->bitmap_offset = header_end;
+    block->pages_offset = ROUND_UP(header_end +
+                                   mapped_ram_bitmap_size(block->used_length),
+                                   MAPPED_RAM_PAGES_ALIGN);
+
+    qemu_put_be64(f, block->bitmap_offset);
+    qemu_put_be64(f, block->pages_offset);
+
+    trace_mapped_ram_save_block_header(block->idstr, block->bitmap_offset,
+                                       block->pages_offset);
+    return qemu_set_offset(f, block->pages_offset + block->used_length);
+}
+
+/**
+ * mapped_ram_save_bitmaps: write the bitmap of the pages present in the
+ *   file for each RAMBlock, once all pages have been written
+ *
+ * Returns 0 for success or negative value on error
+ *
+ * @f: QEMUFile where to send the data
+ */
+static int mapped_ram_save_bitmaps(QEMUFile *f)
+{
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+        size_t size = mapped_ram_bitmap_size(block->used_length);
+        g_autofree unsigned long *le_bitmap =
+            bitmap_new(ROUND_UP(pages, 64));
+
+        bitmap_to_le(le_bitmap, block->file_bmap, pages);
+        if (qemu_put_buffer_at(f, (uint8_t *)le_bitmap, size,
+                               block->bitmap_offset) != size) {
+            return qemu_file_get_error(f);
+        }
+    }
+
+    return 0;
+}
+
 /*
  * Each of ram_save_setup, ram_save_iterate and ram_save_complete has
  * long-running RCU critical section.  When rcu-reclaims in the code
@@ -2782,13 +2961,19 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_use_mapped_ram() &&
+                mapped_ram_save_block_header(f, block) < 0) {
+                return -1;
+            }
         }
     }
 
     ram_control_before_iterate(f, RAM_CONTROL_SETUP);
     ram_control_after_iterate(f, RAM_CONTROL_SETUP);
 
-    multifd_send_sync_main(f);
+    if (multifd_send_sync_main(f) < 0) {
+        return -1;
+    }
     qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
     qemu_fflush(f);
 
@@ -2888,7 +3073,9 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
 out:
     if (ret >= 0
         && migration_is_setup_or_active(migrate_get_current()->state)) {
-        multifd_send_sync_main(rs->f);
+        if (multifd_send_sync_main(rs->f) < 0) {
+            return -1;
+        }
         qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
         qemu_fflush(f);
         ram_counters.transferred += 8;
@@ -2947,7 +3134,14 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
     }
 
     if (ret >= 0) {
-        multifd_send_sync_main(rs->f);
+        ret = multifd_send_sync_main(rs->f);
+    }
+
+    if (ret >= 0 && migrate_use_mapped_ram()) {
+        ret = mapped_ram_save_bitmaps(f);
+    }
+
+    if (ret >= 0) {
         qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
         qemu_fflush(f);
     }
@@ -3421,22 +3615,43 @@ static int ram_load_setup(QEMUFile *f, void *opaque)
     return 0;
 }
 
-static int ram_load_cleanup(void *opaque)
+/**
+ * ram_load_bitmaps_cleanup: write back the loaded RAM and free the
+ *   per-RAMBlock bitmaps used while loading it
+ *
+ * With postcopy-from-file this is deferred until the prefetch thread has
+ * loaded all the pages.
+ */
+void ram_load_bitmaps_cleanup(void)
 {
     RAMBlock *rb;
 
+    RCU_READ_LOCK_GUARD();
+
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         qemu_ram_block_writeback(rb);
     }
 
-    xbzrle_load_cleanup();
-    compress_threads_load_cleanup();
-
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         g_free(rb->receivedmap);
         rb->receivedmap = NULL;
     }
 
+    RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+        g_free(rb->file_bmap);
+        rb->file_bmap = NULL;
+    }
+}
+
+static int ram_load_cleanup(void *opaque)
+{
+    xbzrle_load_cleanup();
+    compress_threads_load_cleanup();
+
+    if (!migration_incoming_get_current()->have_prefetch_thread) {
+        ram_load_bitmaps_cleanup();
+    }
+
     return 0;
 }
 
@@ -3691,6 +3906,129 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+/**
+ * mapped_ram_load_block: load the pages of a RAMBlock from their position
+ *   in the migration file, then continue the stream after them
+ *
+ * With postcopy-from-file only the layout of the block is read; the pages
+ * are loaded later through mapped_ram_read_page().
+ *
+ * Returns 0 for success or negative value on error
+ *
+ * @f: QEMUFile where to receive the data
+ * @block: RAMBlock being loaded
+ * @length: used length of @block in the file
+ */
+static int mapped_ram_load_block(QEMUFile *f, RAMBlock *block,
+                                 ram_addr_t length)
+{
+    unsigned long pages = length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = mapped_ram_bitmap_size(length);
+    g_autofree unsigned long *le_bitmap = NULL;
+    unsigned long run_start, run_end;
+
+    block->bitmap_offset = qemu_get_be64(f);
+    block->pages_offset = qemu_get_be64(f);
+    trace_mapped_ram_load_block(block->idstr, block->bitmap_offset,
+                                block->pages_offset);
+
+    if (block->pages_offset < block->bitmap_offset + bitmap_size ||
+        !QEMU_IS_ALIGNED(block->pages_offset, TARGET_PAGE_SIZE)) {
+        error_report("Invalid mapped-ram layout for block %s", block->idstr);
+        return -EINVAL;
+    }
+
+    g_free(block->file_bmap);
+    block->file_bmap = bitmap_new(ROUND_UP(pages, 64));
+    le_bitmap = bitmap_new(ROUND_UP(pages, 64));
+    if (qemu_get_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           block->bitmap_offset) != bitmap_size) {
+        return -EIO;
+    }
+    bitmap_from_le(block->file_bmap, le_bitmap, pages);
+
+    if (migrate_postcopy_from_file()) {
+        return qemu_set_offset(f, block->pages_offset + length);
+    }
+
+    /* Pages that are not in the file are zero, as is our RAM */
+    run_start = find_first_bit(block->file_bmap, pages);
+    while (run_start < pages) {
+        ram_addr_t offset = (ram_addr_t)run_start << TARGET_PAGE_BITS;
+        size_t len;
+
+        run_end = find_next_zero_bit(block->file_bmap, pages, run_start + 1);
+        len = (run_end - run_start) << TARGET_PAGE_BITS;
+        if (qemu_get_buffer_at(f, block->host + offset, len,
+                               block->pages_offset + offset) != len) {
+            return -EIO;
+        }
+        run_start = find_next_bit(block->file_bmap, pages, run_end);
+    }
+
+    return qemu_set_offset(f, block->pages_offset + length);
+}
+
+/**
+ * mapped_ram_read_page: read a host page of a RAMBlock from its position
+ *   in the migration file
+ *
+ * Returns 1 if none of its target pages are in the file, and thus the page
+ * is zero and @buf is left untouched, 0 if it was read into @buf, or
+ * negative value on error
+ *
+ * @ioc: channel on the migration file
+ * @block: RAMBlock loaded by mapped_ram_load_block()
+ * @offset: offset of the host page inside @block
+ * @buf: where to read the page, of qemu_ram_pagesize(@block) bytes
+ */
+int mapped_ram_read_page(QIOChannel *ioc, RAMBlock *block, ram_addr_t offset,
+                         void *buf)
+{
+    size_t pagesize = qemu_ram_pagesize(block);
+    unsigned long first = offset >> TARGET_PAGE_BITS;
+    unsigned long last = (offset + pagesize) >> TARGET_PAGE_BITS;
+    unsigned long page;
+    size_t done = 0;
+
+    if (find_next_bit(block->file_bmap, last, first) >= last) {
+        return 1;
+    }
+
+    while (done < pagesize) {
+        struct iovec iov = {
+            .iov_base = buf + done,
+            .iov_len = pagesize - done,
+        };
+        Error *local_err = NULL;
+        ssize_t len;
+
+        len = qio_channel_preadv(ioc, &iov, 1,
+                                 block->pages_offset + offset + done,
+                                 &local_err);
+        if (len <= 0) {
+            if (local_err) {
+                error_report_err(local_err);
+            } else {
+                error_report("Unexpected end of migration file in block %s",
+                             block->idstr);
+            }
+            return -EIO;
+        }
+        done += len;
+    }
+
+    /* The file may hold stale data for pages that became zero since */
+    for (page = first; page < last; page++) {
+        if (!test_bit(page, block->file_bmap)) {
+            memset(buf + ((page - first) << TARGET_PAGE_BITS), 0,
+                   TARGET_PAGE_SIZE);
+        }
+    }
+
+    return 0;
+}
+
 /**
  * ram_load_precopy: load pages in precopy case
  *
@@ -3830,6 +4168,9 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_use_mapped_ram()) {
+                        ret = mapped_ram_load_block(f, block, length);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -3840,6 +4181,14 @@ static int ram_load_precopy(QEMUFile *f)
 
                 total_ram_bytes -= length;
             }
+            /*
+             * The devices loaded after RAM may touch it, so the pages
+             * must be served from the file from now on.
+             */
+            if (!ret && migrate_postcopy_from_file()) {
+                ret = postcopy_file_incoming_setup(
+                          migration_incoming_get_current());
+            }
             break;
 
         case RAM_SAVE_FLAG_ZERO:
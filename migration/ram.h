@@ -73,6 +73,11 @@ int64_t ramblock_recv_bitmap_send(QEMUFile *file,
                                   const char *block_name);
 int ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *rb);
 
+/* Mapped-ram */
+int mapped_ram_read_page(QIOChannel *ioc, RAMBlock *block, ram_addr_t offset,
+                         void *buf);
+void ram_load_bitmaps_cleanup(void);
+
 /* ram cache */
 int colo_init_ram_cache(void);
 void colo_flush_ram_cache(void);
@@ -84,5 +89,7 @@ bool ram_write_tracking_available(void);
 bool ram_write_tracking_compatible(void);
 int ram_write_tracking_start(void);
 void ram_write_tracking_stop(void);
+int ram_write_tracking_release(RAMBlock *rb, ram_addr_t start,
+                               ram_addr_t length);
 
 #endif
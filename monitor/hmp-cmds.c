@@ -284,6 +284,17 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->multifd_bytes >> 10);
         monitor_printf(mon, "pages-per-second: %" PRIu64 "\n",
                        info->ram->pages_per_second);
+        if (info->ram->dedup_pages) {
+            monitor_printf(mon, "dedup pages: %" PRIu64 " pages\n",
+                           info->ram->dedup_pages);
+            monitor_printf(mon, "dedup bytes: %" PRIu64 " kbytes\n",
+                           info->ram->dedup_bytes >> 10);
+        }
+        if (info->ram->dirty_sync_missed_zero_copy) {
+            monitor_printf(mon,
+                           "zero-copy-send fallbacks: %" PRIu64 " times\n",
+                           info->ram->dirty_sync_missed_zero_copy);
+        }
 
         if (info->ram->dirty_pages_rate) {
             monitor_printf(mon, "dirty pages rate: %" PRIu64 " pages\n",
@@ -283,6 +283,12 @@ int qemu_plugin_load_list(QemuPluginList *head, Error **errp)
     info->system_emulation = true;
     info->system.smp_vcpus = ms->smp.cpus;
     info->system.max_vcpus = ms->smp.max_cpus;
+    /*
+     * Size scoreboards for all the vCPUs the machine can have, so that
+     * hotplug never has to move them while other vCPUs run.
+     */
+    plugin.scoreboard_alloc_size = MAX(plugin.scoreboard_alloc_size,
+                                       pow2ceil(ms->smp.max_cpus));
 #else
     info->system_emulation = false;
 #endif
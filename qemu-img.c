@@ -1701,6 +1701,8 @@ typedef struct ImgConvertState {
     int running_coroutines;
     Coroutine *co[MAX_COROUTINES];
     int64_t wait_sector_num[MAX_COROUTINES];
+    int compressed_in_flight;
+    Coroutine *compressed_drain_waiter;
     CoMutex lock;
     int ret;
 } ImgConvertState;
@@ -1972,6 +1974,84 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
     return 0;
 }
 
+typedef struct ImgConvertWrite {
+    ImgConvertState *s;
+    int64_t sector_num;
+    int nb_sectors;
+    uint8_t *buf;
+    enum ImgConvertBlockStatus status;
+    Coroutine *waiter;
+    bool done;
+    int ret;
+} ImgConvertWrite;
+
+static void coroutine_fn convert_co_write_entry(void *opaque)
+{
+    ImgConvertWrite *w = opaque;
+
+    ImgConvertState *s = w->s;
+
+    w->ret = convert_co_write(s, w->sector_num, w->nb_sectors, w->buf,
+                              w->status);
+    w->done = true;
+    if (w->waiter) {
+        aio_co_wake(w->waiter);
+    }
+    if (!--s->compressed_in_flight && s->compressed_drain_waiter) {
+        aio_co_wake(s->compressed_drain_waiter);
+    }
+}
+
+/*
+ * Compressed writes are mostly CPU work, which the format driver hands to
+ * its worker threads.  Rather than waiting for a compressed write to
+ * complete before starting the next one, only wait until it has been
+ * submitted: the drivers allocate compressed clusters in the order the
+ * writes were started, so the output stays the same as if the writes ran
+ * one at a time, while the compression of consecutive clusters overlaps.
+ *
+ * Returns once the write has been submitted; *w tells when it completes.
+ */
+static void coroutine_fn convert_co_write_submit(ImgConvertWrite *w)
+{
+    w->s->compressed_in_flight++;
+    qemu_coroutine_enter(qemu_coroutine_create(convert_co_write_entry, w));
+}
+
+/*
+ * Only compressed writes are allocated in the order in which they start.
+ * Any other write, zero writes included, may allocate clusters of its own
+ * and would overtake the compressed writes that are still in flight, so
+ * wait for those to complete first.
+ */
+static void coroutine_fn convert_co_compressed_drain(ImgConvertState *s)
+{
+    while (s->compressed_in_flight) {
+        s->compressed_drain_waiter = qemu_coroutine_self();
+        qemu_coroutine_yield();
+    }
+    s->compressed_drain_waiter = NULL;
+}
+
+/* Whether convert_co_write() issues nothing but compressed writes */
+static bool convert_is_compressed_write(ImgConvertState *s, int nb_sectors,
+                                        uint8_t *buf,
+                                        enum ImgConvertBlockStatus status)
+{
+    return s->compressed && status == BLK_DATA &&
+           (!s->min_sparse ||
+            !buffer_is_zero(buf, nb_sectors * BDRV_SECTOR_SIZE));
+}
+
+static int coroutine_fn convert_co_write_wait(ImgConvertWrite *w)
+{
+    while (!w->done) {
+        w->waiter = qemu_coroutine_self();
+        qemu_coroutine_yield();
+    }
+    return w->ret;
+}
+
 static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
@@ -1995,6 +2075,7 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         int64_t sector_num;
         enum ImgConvertBlockStatus status;
         bool copy_range;
+        ImgConvertWrite w = { .done = true };
 
         qemu_co_mutex_lock(&s->lock);
         if (s->ret != -EINPROGRESS || s->sector_num >= s->total_sectors) {
@@ -2054,7 +2135,21 @@ retry:
                     s->copy_range = false;
                     goto retry;
                 }
+            } else if (s->wr_in_order &&
+                       convert_is_compressed_write(s, n, buf, status)) {
+                w = (ImgConvertWrite) {
+                    .s = s,
+                    .sector_num = sector_num,
+                    .nb_sectors = n,
+                    .buf = buf,
+                    .status = status,
+                };
+                convert_co_write_submit(&w);
+                ret = 0;
             } else {
+                if (s->wr_in_order) {
+                    convert_co_compressed_drain(s);
+                }
                 ret = convert_co_write(s, sector_num, n, buf, status);
             }
             if (ret < 0) {
@@ -2080,6 +2175,14 @@ retry:
                 }
             }
         }
+
+        /* buf is reused by the next iteration */
+        ret = convert_co_write_wait(&w);
+        if (ret < 0) {
+            error_report("error while writing at byte %lld: %s",
+                         sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
+            s->ret = ret;
+        }
     }
 
     qemu_vfree(buf);
@@ -139,8 +139,10 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-cache=file (save and reuse TCG translations across runs)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -165,6 +167,16 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``dirty-ring-size=n``
+        When the KVM accelerator is used, it controls the size of the per-vCPU
+        dirty page ring buffer (number of entries for each vCPU). It should
+        be a value that is power of two, and it should be 1024 or bigger (but
+        still less than the maximum value that the kernel supports).  4096
+        could be a good initial value if you have no idea which is the best.
+        Set this value to 0 to disable the feature.  By default, this feature
+        is disabled (dirty-ring-size=0).  When disabled, KVM will instead
+        record dirty pages in a bitmap.
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
@@ -174,6 +186,16 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-cache=file``
+        Saves the code translated by TCG to ``file`` when QEMU exits, and
+        reuses it on the next run instead of translating the same guest
+        code again.  The saved code is only used by the same QEMU binary,
+        on the same host CPU, with the same machine and CPU configuration;
+        otherwise the file is replaced.  Each translation block is also
+        checked against the current guest code before being reused.  The
+        ``info jit`` monitor command shows the cache hit rate.  Only
+        supported for system emulation on x86-64 Linux hosts.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefor taking advantage of
@@ -4141,8 +4163,9 @@ DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "                specified protocol and socket address\n" \
     "-incoming fd:fd\n" \
     "-incoming exec:cmdline\n" \
-    "                accept incoming migration on given file descriptor\n" \
-    "                or from given external command\n" \
+    "-incoming file:filename\n" \
+    "                accept incoming migration on given file descriptor,\n" \
+    "                from given external command or from given file\n" \
     "-incoming defer\n" \
     "                wait for the URI to be specified via migrate_incoming\n",
     QEMU_ARCH_ALL)
@@ -4162,6 +4185,10 @@ SRST
     Accept incoming migration as an output from specified external
     command.
 
+``-incoming file:filename``
+    Accept incoming migration from a file written by ``migrate
+    file:filename``.
+
 ``-incoming defer``
     Wait for the URI to be specified via migrate\_incoming. The monitor
     can be used to change settings (such as migration parameters) prior
@@ -5136,7 +5163,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,io-uring-sqpoll=on|off,io-uring-sq-thread-idle=ms,io-uring-sq-thread-cpu=cpu,io-uring-iopoll=on|off``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -5179,6 +5206,28 @@ SRST
         ::
 
             (qemu) qom-set /objects/iothread1 poll-max-ns 100000
+
+        The io_uring that block devices with ``aio=io_uring`` use in the
+        IOThread can be set up with the following parameters, which
+        cannot be changed at run-time:
+
+        The ``io-uring-sqpoll`` parameter makes a kernel thread submit the
+        requests, so that the IOThread does not have to enter the kernel
+        while the kernel thread is awake.  ``io-uring-sq-thread-idle`` is
+        the number of milliseconds after which the kernel thread goes to
+        sleep when there is no I/O, and ``io-uring-sq-thread-cpu`` the
+        host CPU that it runs on.
+
+        The ``io-uring-iopoll`` parameter polls the device for completions
+        instead of waiting for an interrupt.  It requires ``cache.direct=on``
+        and a device with poll queues, such as NVMe with the
+        ``nvme.poll_queues`` module parameter; flushes and buffered I/O go
+        through the thread pool.  Without ``io-uring-sqpoll`` the IOThread
+        busy-polls while requests are in flight.
+
+        Together with adaptive polling, the two let a busy IOThread submit
+        and complete requests without system calls.  The ``io-uring``
+        member of ``query-blockstats`` reports the ring's counters.
 ERST
 
 
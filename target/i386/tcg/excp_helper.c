@@ -652,8 +652,16 @@ do_check_protect_pse36:
     paddr &= TARGET_PAGE_MASK;
 
     assert(prot & (1 << is_write1));
-    tlb_set_page_with_attrs(cs, vaddr, paddr, cpu_get_mem_attrs(env),
-                            prot, mmu_idx, page_size);
+    if (page_size > TARGET_PAGE_SIZE && a20_mask == -1 &&
+        !(env->hflags2 & HF2_NPT_MASK)) {
+        /* Neither A20 masking nor nested paging splits the large page */
+        tlb_set_large_page_with_attrs(cs, vaddr, paddr,
+                                      cpu_get_mem_attrs(env),
+                                      prot, mmu_idx, page_size);
+    } else {
+        tlb_set_page_with_attrs(cs, vaddr, paddr, cpu_get_mem_attrs(env),
+                                prot, mmu_idx, page_size);
+    }
     return 0;
  do_fault_rsvd:
     error_code |= PG_ERROR_RSVD_MASK;
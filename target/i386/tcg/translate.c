@@ -23,6 +23,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg-op.h"
+#include "tcg/tcg-op-gvec.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translator.h"
 
@@ -2230,11 +2231,49 @@ static inline void gen_goto_tb(DisasContext *s, int tb_num, target_ulong eip)
     }
 }
 
+/* Keep translating at EIP, if the TB is a trace that can follow the jump */
+static bool gen_trace_jmp(DisasContext *s, target_ulong eip)
+{
+    if (!s->jmp_opt || (s->flags & HF_RF_MASK) ||
+        !translator_trace_jump(&s->base, s->pc, s->cs_base + eip)) {
+        return false;
+    }
+    s->pc = s->cs_base + eip;
+    return true;
+}
+
+/*
+ * Leave a trace on the side of a branch that it does not follow.  Both
+ * goto_tb slots are kept for the jumps that end the trace.
+ */
+static void gen_trace_exit(DisasContext *s, target_ulong eip)
+{
+    gen_jmp_im(s, eip);
+    gen_jr(s, s->tmp0);
+    s->base.is_jmp = DISAS_NEXT;
+}
+
 static inline void gen_jcc(DisasContext *s, int b,
                            target_ulong val, target_ulong next_eip)
 {
     TCGLabel *l1, *l2;
 
+    /* Traces follow backward branches, which are likely loops */
+    if (val < next_eip && gen_trace_jmp(s, val)) {
+        l1 = gen_new_label();
+        gen_jcc1(s, b, l1);
+        gen_trace_exit(s, next_eip);
+        gen_set_label(l1);
+        return;
+    }
+    if (gen_trace_jmp(s, next_eip)) {
+        l1 = gen_new_label();
+        gen_jcc1(s, b ^ 1, l1);
+        gen_trace_exit(s, val);
+        gen_set_label(l1);
+        return;
+    }
+
     if (s->jmp_opt) {
         l1 = gen_new_label();
         gen_jcc1(s, b, l1);
@@ -2675,10 +2714,7 @@ static inline void gen_sto_env_A0(DisasContext *s, int offset)
 
 static inline void gen_op_movo(DisasContext *s, int d_offset, int s_offset)
 {
-    tcg_gen_ld_i64(s->tmp1_i64, cpu_env, s_offset + offsetof(ZMMReg, ZMM_Q(0)));
-    tcg_gen_st_i64(s->tmp1_i64, cpu_env, d_offset + offsetof(ZMMReg, ZMM_Q(0)));
-    tcg_gen_ld_i64(s->tmp1_i64, cpu_env, s_offset + offsetof(ZMMReg, ZMM_Q(1)));
-    tcg_gen_st_i64(s->tmp1_i64, cpu_env, d_offset + offsetof(ZMMReg, ZMM_Q(1)));
+    tcg_gen_gvec_mov(MO_64, d_offset, s_offset, 16, 16);
 }
 
 static inline void gen_op_movq(DisasContext *s, int d_offset, int s_offset)
@@ -2851,6 +2887,150 @@ static const SSEFunc_0_epp sse_op_table1[256][4] = {
     [0xfe] = MMX_OP2(paddl),
 };
 
+typedef void GVecGen3Fn(unsigned, uint32_t, uint32_t,
+                        uint32_t, uint32_t, uint32_t);
+
+typedef struct SSEGvecOp {
+    GVecGen3Fn *fn;
+    MemOp vece;
+} SSEGvecOp;
+
+static void gen_gvec_pandn(unsigned vece, uint32_t dofs, uint32_t aofs,
+                           uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    /* The destination is the operand that gets inverted.  */
+    tcg_gen_gvec_andc(vece, dofs, bofs, aofs, oprsz, maxsz);
+}
+
+static void gen_gvec_pcmpeq(unsigned vece, uint32_t dofs, uint32_t aofs,
+                            uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    tcg_gen_gvec_cmp(TCG_COND_EQ, vece, dofs, aofs, bofs, oprsz, maxsz);
+}
+
+static void gen_gvec_pcmpgt(unsigned vece, uint32_t dofs, uint32_t aofs,
+                            uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    tcg_gen_gvec_cmp(TCG_COND_GT, vece, dofs, aofs, bofs, oprsz, maxsz);
+}
+
+static void gen_gvec_pabs(unsigned vece, uint32_t dofs, uint32_t aofs,
+                          uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    tcg_gen_gvec_abs(vece, dofs, bofs, oprsz, maxsz);
+}
+
+/*
+ * Integer operations of sse_op_table1 that are expanded inline as
+ * generic vector operations rather than calling the helpers; the MMX
+ * and SSE forms only differ in the size of the operands.
+ */
+static const SSEGvecOp sse_gvec_table1[256] = {
+    [0x54] = { tcg_gen_gvec_and, MO_64 }, /* andps, andpd */
+    [0x55] = { gen_gvec_pandn, MO_64 },   /* andnps, andnpd */
+    [0x56] = { tcg_gen_gvec_or, MO_64 },  /* orps, orpd */
+    [0x57] = { tcg_gen_gvec_xor, MO_64 }, /* xorps, xorpd */
+    [0x64] = { gen_gvec_pcmpgt, MO_8 },
+    [0x65] = { gen_gvec_pcmpgt, MO_16 },
+    [0x66] = { gen_gvec_pcmpgt, MO_32 },
+    [0x74] = { gen_gvec_pcmpeq, MO_8 },
+    [0x75] = { gen_gvec_pcmpeq, MO_16 },
+    [0x76] = { gen_gvec_pcmpeq, MO_32 },
+    [0xd4] = { tcg_gen_gvec_add, MO_64 },   /* paddq */
+    [0xd5] = { tcg_gen_gvec_mul, MO_16 },   /* pmullw */
+    [0xd8] = { tcg_gen_gvec_ussub, MO_8 },  /* psubusb */
+    [0xd9] = { tcg_gen_gvec_ussub, MO_16 }, /* psubusw */
+    [0xda] = { tcg_gen_gvec_umin, MO_8 },   /* pminub */
+    [0xdb] = { tcg_gen_gvec_and, MO_64 },   /* pand */
+    [0xdc] = { tcg_gen_gvec_usadd, MO_8 },  /* paddusb */
+    [0xdd] = { tcg_gen_gvec_usadd, MO_16 }, /* paddusw */
+    [0xde] = { tcg_gen_gvec_umax, MO_8 },   /* pmaxub */
+    [0xdf] = { gen_gvec_pandn, MO_64 },     /* pandn */
+    [0xe8] = { tcg_gen_gvec_sssub, MO_8 },  /* psubsb */
+    [0xe9] = { tcg_gen_gvec_sssub, MO_16 }, /* psubsw */
+    [0xea] = { tcg_gen_gvec_smin, MO_16 },  /* pminsw */
+    [0xeb] = { tcg_gen_gvec_or, MO_64 },    /* por */
+    [0xec] = { tcg_gen_gvec_ssadd, MO_8 },  /* paddsb */
+    [0xed] = { tcg_gen_gvec_ssadd, MO_16 }, /* paddsw */
+    [0xee] = { tcg_gen_gvec_smax, MO_16 },  /* pmaxsw */
+    [0xef] = { tcg_gen_gvec_xor, MO_64 },   /* pxor */
+    [0xf8] = { tcg_gen_gvec_sub, MO_8 },    /* psubb */
+    [0xf9] = { tcg_gen_gvec_sub, MO_16 },   /* psubw */
+    [0xfa] = { tcg_gen_gvec_sub, MO_32 },   /* psubl */
+    [0xfb] = { tcg_gen_gvec_sub, MO_64 },   /* psubq */
+    [0xfc] = { tcg_gen_gvec_add, MO_8 },    /* paddb */
+    [0xfd] = { tcg_gen_gvec_add, MO_16 },   /* paddw */
+    [0xfe] = { tcg_gen_gvec_add, MO_32 },   /* paddl */
+};
+
+/* Likewise for sse_op_table6.  */
+static const SSEGvecOp sse_gvec_table6[256] = {
+    [0x1c] = { gen_gvec_pabs, MO_8 },       /* pabsb */
+    [0x1d] = { gen_gvec_pabs, MO_16 },      /* pabsw */
+    [0x1e] = { gen_gvec_pabs, MO_32 },      /* pabsd */
+    [0x29] = { gen_gvec_pcmpeq, MO_64 },    /* pcmpeqq */
+    [0x37] = { gen_gvec_pcmpgt, MO_64 },    /* pcmpgtq */
+    [0x38] = { tcg_gen_gvec_smin, MO_8 },   /* pminsb */
+    [0x39] = { tcg_gen_gvec_smin, MO_32 },  /* pminsd */
+    [0x3a] = { tcg_gen_gvec_umin, MO_16 },  /* pminuw */
+    [0x3b] = { tcg_gen_gvec_umin, MO_32 },  /* pminud */
+    [0x3c] = { tcg_gen_gvec_smax, MO_8 },   /* pmaxsb */
+    [0x3d] = { tcg_gen_gvec_smax, MO_32 },  /* pmaxsd */
+    [0x3e] = { tcg_gen_gvec_umax, MO_16 },  /* pmaxuw */
+    [0x3f] = { tcg_gen_gvec_umax, MO_32 },  /* pmaxud */
+    [0x40] = { tcg_gen_gvec_mul, MO_32 },   /* pmulld */
+};
+
+/*
+ * Expand @op on the MMX or the low 128 bits of the XMM register at
+ * @op1_offset, leaving the high part of the YMM register alone.
+ * Return false if @op has no generic vector expansion.
+ */
+static bool gen_sse_gvec(const SSEGvecOp *op, int is_xmm,
+                         int op1_offset, int op2_offset)
+{
+    int sz = is_xmm ? 16 : 8;
+
+    if (!op->fn) {
+        return false;
+    }
+    op->fn(op->vece, op1_offset, op1_offset, op2_offset, sz, sz);
+    return true;
+}
+
+/*
+ * Expand the shift by immediate @op, an index into sse_op_table2,
+ * on the register at @offset.  Return false for the byte shifts.
+ */
+static bool gen_sse_shift_gvec(int op, int is_xmm, int offset, int shift)
+{
+    int sz = is_xmm ? 16 : 8;
+    MemOp vece = MO_16 + op / 8;
+    int bits = 8 << vece;
+
+    switch (op & 7) {
+    case 2: /* psrl */
+        if (shift >= bits) {
+            tcg_gen_gvec_dup_imm(vece, offset, sz, sz, 0);
+        } else {
+            tcg_gen_gvec_shri(vece, offset, offset, shift, sz, sz);
+        }
+        return true;
+    case 4: /* psra */
+        tcg_gen_gvec_sari(vece, offset, offset, MIN(shift, bits - 1), sz, sz);
+        return true;
+    case 6: /* psll */
+        if (shift >= bits) {
+            tcg_gen_gvec_dup_imm(vece, offset, sz, sz, 0);
+        } else {
+            tcg_gen_gvec_shli(vece, offset, offset, shift, sz, sz);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
 static const SSEFunc_0_epp sse_op_table2[3 * 8][2] = {
     [0 + 2] = MMX_OP2(psrlw),
     [0 + 4] = MMX_OP2(psraw),
@@ -3032,7 +3212,7 @@ static const struct SSEOpHelper_eppi sse_op_table7[256] = {
 static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                     target_ulong pc_start, int rex_r)
 {
-    int b1, op1_offset, op2_offset, is_xmm, val;
+    int b1, op1_offset, op2_offset, is_xmm, val, op;
     int modrm, mod, rm, reg;
     SSEFunc_0_epp sse_fn_epp;
     SSEFunc_0_eppi sse_fn_eppi;
@@ -3446,6 +3626,21 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                 goto unknown_op;
             }
             val = x86_ldub_code(env, s);
+            op = ((b - 1) & 3) * 8 + ((modrm >> 3) & 7);
+            sse_fn_epp = sse_op_table2[op][b1];
+            if (!sse_fn_epp) {
+                goto unknown_op;
+            }
+            if (is_xmm) {
+                rm = (modrm & 7) | REX_B(s);
+                op2_offset = offsetof(CPUX86State,xmm_regs[rm]);
+            } else {
+                rm = (modrm & 7);
+                op2_offset = offsetof(CPUX86State,fpregs[rm].mmx);
+            }
+            if (gen_sse_shift_gvec(op, is_xmm, op2_offset, val)) {
+                break;
+            }
             if (is_xmm) {
                 tcg_gen_movi_tl(s->T0, val);
                 tcg_gen_st32_tl(s->T0, cpu_env,
@@ -3463,18 +3658,6 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
                                 offsetof(CPUX86State, mmx_t0.MMX_L(1)));
                 op1_offset = offsetof(CPUX86State,mmx_t0);
             }
-            sse_fn_epp = sse_op_table2[((b - 1) & 3) * 8 +
-                                       (((modrm >> 3)) & 7)][b1];
-            if (!sse_fn_epp) {
-                goto unknown_op;
-            }
-            if (is_xmm) {
-                rm = (modrm & 7) | REX_B(s);
-                op2_offset = offsetof(CPUX86State,xmm_regs[rm]);
-            } else {
-                rm = (modrm & 7);
-                op2_offset = offsetof(CPUX86State,fpregs[rm].mmx);
-            }
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op2_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op1_offset);
             sse_fn_epp(cpu_env, s->ptr0, s->ptr1);
@@ -3751,6 +3934,9 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             if (sse_fn_epp == SSE_SPECIAL) {
                 goto unknown_op;
             }
+            if (gen_sse_gvec(&sse_gvec_table6[b], b1, op1_offset, op2_offset)) {
+                break;
+            }
 
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
@@ -4463,6 +4649,10 @@ static void gen_sse(CPUX86State *env, DisasContext *s, int b,
             sse_fn_eppt(cpu_env, s->ptr0, s->ptr1, s->A0);
             break;
         default:
+            if (gen_sse_gvec(&sse_gvec_table1[b], is_xmm,
+                             op1_offset, op2_offset)) {
+                break;
+            }
             tcg_gen_addi_ptr(s->ptr0, cpu_env, op1_offset);
             tcg_gen_addi_ptr(s->ptr1, cpu_env, op2_offset);
             sse_fn_epp(cpu_env, s->ptr0, s->ptr1);
@@ -6586,7 +6776,9 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             tcg_gen_movi_tl(s->T0, next_eip);
             gen_push_v(s, s->T0);
             gen_bnd_jmp(s);
-            gen_jmp(s, tval);
+            if (!gen_trace_jmp(s, tval)) {
+                gen_jmp(s, tval);
+            }
         }
         break;
     case 0x9a: /* lcall im */
@@ -6616,7 +6808,9 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
             tval &= 0xffffffff;
         }
         gen_bnd_jmp(s);
-        gen_jmp(s, tval);
+        if (!gen_trace_jmp(s, tval)) {
+            gen_jmp(s, tval);
+        }
         break;
     case 0xea: /* ljmp im */
         {
@@ -6638,7 +6832,9 @@ static target_ulong disas_insn(DisasContext *s, CPUState *cpu)
         if (dflag == MO_16) {
             tval &= 0xffff;
         }
-        gen_jmp(s, tval);
+        if (!gen_trace_jmp(s, tval)) {
+            gen_jmp(s, tval);
+        }
         break;
     case 0x70 ... 0x7f: /* jcc Jb */
         tval = (int8_t)insn_get(env, s, MO_8);
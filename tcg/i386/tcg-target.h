@@ -235,5 +235,9 @@ static inline void tb_target_set_jmp_target(uintptr_t tc_ptr, uintptr_t jmp_rx,
 #define TCG_TARGET_NEED_LDST_LABELS
 #endif
 #define TCG_TARGET_NEED_POOL_LABELS
+#if TCG_TARGET_REG_BITS == 64
+/* The references to host addresses are recorded, see tcg_out_ext_ref() */
+#define TCG_TARGET_EXT_REFS
+#endif
 
 #endif
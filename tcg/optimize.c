@@ -597,6 +597,412 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
+/*
+ * Value numbering of the temps within a basic block.  Each value written
+ * to a temp gets a new number, which moves propagate.  Pure operations
+ * and loads from env are looked up by the numbers of their inputs; when
+ * the same value was computed before and a temp still holds it, the
+ * operation becomes a move.  Stores to env are tracked until something
+ * may read them, so that a store overwritten before that is removed.
+ */
+
+#define OPT_VN_HASH_BITS    6
+#define OPT_VN_HASH_SIZE    (1 << OPT_VN_HASH_BITS)
+#define OPT_VN_MAX_KEY      6
+#define OPT_ENV_SLOTS       16
+
+typedef struct OptVNEntry {
+    TCGOpcode opc;
+    int nb_key;
+    TCGArg key[OPT_VN_MAX_KEY];
+    uint32_t vn;
+    TCGTemp *holder;
+} OptVNEntry;
+
+/* A location in env, whose value is known or whose store is pending */
+typedef struct OptEnvSlot {
+    intptr_t ofs;
+    int size;
+    TCGOpcode ld_opc;   /* Load that reads back the value, or NB_OPS */
+    uint32_t vn;
+    TCGTemp *holder;
+    TCGOp *store;       /* Store that nothing has read yet, or NULL */
+} OptEnvSlot;
+
+typedef struct OptVNState {
+    uint32_t *vn;
+    uint32_t next_vn;
+    OptVNEntry table[OPT_VN_HASH_SIZE];
+    OptEnvSlot env[OPT_ENV_SLOTS];
+    int nb_env;
+} OptVNState;
+
+static uint32_t vn_get(OptVNState *st, TCGTemp *ts)
+{
+    uint32_t *vn = &st->vn[temp_idx(ts)];
+
+    if (*vn == 0) {
+        *vn = ++st->next_vn;
+    }
+    return *vn;
+}
+
+static uint32_t vn_new(OptVNState *st, TCGTemp *ts)
+{
+    return st->vn[temp_idx(ts)] = ++st->next_vn;
+}
+
+static void vn_reset(TCGContext *s, OptVNState *st)
+{
+    memset(st->vn, 0, sizeof(uint32_t) * s->nb_temps);
+    memset(st->table, 0, sizeof(st->table));
+    st->nb_env = 0;
+}
+
+static bool vn_holds(OptVNState *st, TCGTemp *ts, uint32_t vn)
+{
+    return ts && st->vn[temp_idx(ts)] == vn;
+}
+
+/* Replace OP, which writes VN to DST, with a move from HOLDER */
+static void vn_gen_mov(TCGContext *s, TCGOp *op, TCGTemp *dst,
+                       TCGTemp *holder)
+{
+    if (dst == holder) {
+        tcg_op_remove(s, op);
+        return;
+    }
+    op->opc = dst->type == TCG_TYPE_I32 ? INDEX_op_mov_i32
+                                        : INDEX_op_mov_i64;
+    op->args[1] = temp_arg(holder);
+}
+
+static int env_access_size(TCGOpcode opc)
+{
+    switch (opc) {
+    case INDEX_op_ld8u_i32:
+    case INDEX_op_ld8s_i32:
+    case INDEX_op_st8_i32:
+    case INDEX_op_ld8u_i64:
+    case INDEX_op_ld8s_i64:
+    case INDEX_op_st8_i64:
+        return 1;
+    case INDEX_op_ld16u_i32:
+    case INDEX_op_ld16s_i32:
+    case INDEX_op_st16_i32:
+    case INDEX_op_ld16u_i64:
+    case INDEX_op_ld16s_i64:
+    case INDEX_op_st16_i64:
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_st_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+    case INDEX_op_st_i64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+static bool env_slot_overlaps(OptEnvSlot *e, intptr_t ofs, int size)
+{
+    return e->ofs < ofs + size && ofs < e->ofs + e->size;
+}
+
+static void env_slot_add(OptVNState *st, intptr_t ofs, int size,
+                         TCGOpcode ld_opc, uint32_t vn, TCGTemp *holder,
+                         TCGOp *store)
+{
+    OptEnvSlot *e;
+
+    if (st->nb_env == OPT_ENV_SLOTS) {
+        memmove(&st->env[0], &st->env[1], sizeof(OptEnvSlot) * --st->nb_env);
+    }
+    e = &st->env[st->nb_env++];
+    e->ofs = ofs;
+    e->size = size;
+    e->ld_opc = ld_opc;
+    e->vn = vn;
+    e->holder = holder;
+    e->store = store;
+}
+
+static void env_slot_remove(OptVNState *st, int i)
+{
+    st->nb_env--;
+    memmove(&st->env[i], &st->env[i + 1],
+            sizeof(OptEnvSlot) * (st->nb_env - i));
+}
+
+/* Something may read env: pending stores must stay */
+static void env_read_all(OptVNState *st)
+{
+    int i;
+
+    for (i = 0; i < st->nb_env; i++) {
+        st->env[i].store = NULL;
+    }
+}
+
+static void env_load(TCGContext *s, OptVNState *st, TCGOp *op)
+{
+    TCGTemp *dst = arg_temp(op->args[0]);
+    intptr_t ofs = op->args[2];
+    int size = env_access_size(op->opc);
+    OptEnvSlot *found = NULL;
+    int i;
+
+    for (i = 0; i < st->nb_env; i++) {
+        OptEnvSlot *e = &st->env[i];
+
+        if (env_slot_overlaps(e, ofs, size)) {
+            e->store = NULL;
+            if (e->ofs == ofs && e->ld_opc == op->opc) {
+                found = e;
+            }
+        }
+    }
+
+    if (found == NULL) {
+        env_slot_add(st, ofs, size, op->opc, vn_new(st, dst), dst, NULL);
+        return;
+    }
+
+    if (vn_holds(st, found->holder, found->vn)) {
+        vn_gen_mov(s, op, dst, found->holder);
+#ifdef CONFIG_PROFILER
+        qatomic_set(&s->prof.load_elim_count, s->prof.load_elim_count + 1);
+#endif
+    } else {
+        found->holder = dst;
+    }
+    st->vn[temp_idx(dst)] = found->vn;
+}
+
+static void env_store(TCGContext *s, OptVNState *st, TCGOp *op)
+{
+    TCGTemp *val = arg_temp(op->args[0]);
+    intptr_t ofs = op->args[2];
+    int size = env_access_size(op->opc);
+    TCGOpcode ld_opc = NB_OPS;
+    uint32_t vn = vn_get(st, val);
+    int i;
+
+    if (op->opc == INDEX_op_st_i32) {
+        ld_opc = INDEX_op_ld_i32;
+    } else if (op->opc == INDEX_op_st_i64) {
+        ld_opc = INDEX_op_ld_i64;
+    }
+
+    for (i = st->nb_env - 1; i >= 0; i--) {
+        OptEnvSlot *e = &st->env[i];
+
+        if (!env_slot_overlaps(e, ofs, size)) {
+            continue;
+        }
+        /* The location already holds the value */
+        if (e->ofs == ofs && e->size == size &&
+            ld_opc != NB_OPS && e->ld_opc == ld_opc && e->vn == vn) {
+            tcg_op_remove(s, op);
+#ifdef CONFIG_PROFILER
+            qatomic_set(&s->prof.store_elim_count,
+                        s->prof.store_elim_count + 1);
+#endif
+            return;
+        }
+    }
+
+    for (i = st->nb_env - 1; i >= 0; i--) {
+        OptEnvSlot *e = &st->env[i];
+
+        if (!env_slot_overlaps(e, ofs, size)) {
+            continue;
+        }
+        /* Overwritten before anything read it */
+        if (e->store && e->ofs >= ofs && e->ofs + e->size <= ofs + size) {
+            tcg_op_remove(s, e->store);
+#ifdef CONFIG_PROFILER
+            qatomic_set(&s->prof.store_elim_count,
+                        s->prof.store_elim_count + 1);
+#endif
+        }
+        env_slot_remove(st, i);
+    }
+    env_slot_add(st, ofs, size, ld_opc, vn, val, op);
+}
+
+static bool vn_pure_op(TCGOpcode opc, const TCGOpDef *def)
+{
+    switch (opc) {
+    case INDEX_op_mov_i32:
+    case INDEX_op_mov_i64:
+        return false;
+    default:
+        break;
+    }
+    return def->nb_oargs == 1 && def->nb_iargs > 0 &&
+           def->nb_iargs + def->nb_cargs <= OPT_VN_MAX_KEY &&
+           env_access_size(opc) == 0 &&
+           !(def->flags & (TCG_OPF_BB_END | TCG_OPF_CALL_CLOBBER |
+                           TCG_OPF_SIDE_EFFECTS | TCG_OPF_VECTOR));
+}
+
+static void vn_pure(TCGContext *s, OptVNState *st, TCGOp *op,
+                    const TCGOpDef *def)
+{
+    TCGTemp *dst = arg_temp(op->args[0]);
+    OptVNEntry key, *e;
+    uint32_t hash = op->opc;
+    int i;
+
+    key.opc = op->opc;
+    key.nb_key = def->nb_iargs + def->nb_cargs;
+    for (i = 0; i < key.nb_key; i++) {
+        TCGArg arg = op->args[1 + i];
+
+        key.key[i] = i < def->nb_iargs ? vn_get(st, arg_temp(arg)) : arg;
+        hash = hash * 31 + key.key[i];
+    }
+
+    e = &st->table[(hash ^ (hash >> OPT_VN_HASH_BITS)) &
+                   (OPT_VN_HASH_SIZE - 1)];
+    if (e->vn && e->opc == key.opc && e->nb_key == key.nb_key &&
+        memcmp(e->key, key.key, sizeof(TCGArg) * key.nb_key) == 0) {
+        if (vn_holds(st, e->holder, e->vn)) {
+            vn_gen_mov(s, op, dst, e->holder);
+#ifdef CONFIG_PROFILER
+            qatomic_set(&s->prof.gvn_count, s->prof.gvn_count + 1);
+#endif
+        } else {
+            e->holder = dst;
+        }
+        st->vn[temp_idx(dst)] = e->vn;
+        return;
+    }
+
+    key.vn = vn_new(st, dst);
+    key.holder = dst;
+    *e = key;
+}
+
+static void eliminate_redundancy(TCGContext *s)
+{
+    OptVNState *st = tcg_malloc(sizeof(OptVNState));
+    TCGTemp *env = tcgv_ptr_temp(cpu_env);
+    TCGOp *op, *op_next;
+    int i;
+
+    st->vn = tcg_malloc(sizeof(uint32_t) * s->nb_temps);
+    st->next_vn = 0;
+    vn_reset(s, st);
+
+    QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
+        TCGOpcode opc = op->opc;
+        const TCGOpDef *def = &tcg_op_defs[opc];
+        int nb_oargs, nb_iargs;
+
+        if (opc == INDEX_op_call) {
+            int call_flags;
+
+            nb_oargs = TCGOP_CALLO(op);
+            nb_iargs = TCGOP_CALLI(op);
+            call_flags = op->args[nb_oargs + nb_iargs + 1];
+
+            /* Helpers are passed env, and may raise exceptions */
+            env_read_all(st);
+            if (!(call_flags & TCG_CALL_NO_SIDE_EFFECTS)) {
+                st->nb_env = 0;
+            }
+            if (!(call_flags & TCG_CALL_NO_WRITE_GLOBALS)) {
+                memset(st->vn, 0, sizeof(uint32_t) * s->nb_globals);
+            }
+            for (i = 0; i < nb_oargs; i++) {
+                vn_new(st, arg_temp(op->args[i]));
+            }
+            continue;
+        }
+
+        if (def->flags & TCG_OPF_BB_END) {
+            vn_reset(s, st);
+            continue;
+        }
+
+        switch (opc) {
+        case INDEX_op_mov_i32:
+        case INDEX_op_mov_i64:
+            st->vn[temp_idx(arg_temp(op->args[0]))] =
+                vn_get(st, arg_temp(op->args[1]));
+            continue;
+
+        case INDEX_op_ld8u_i32:
+        case INDEX_op_ld8s_i32:
+        case INDEX_op_ld16u_i32:
+        case INDEX_op_ld16s_i32:
+        case INDEX_op_ld_i32:
+        case INDEX_op_ld8u_i64:
+        case INDEX_op_ld8s_i64:
+        case INDEX_op_ld16u_i64:
+        case INDEX_op_ld16s_i64:
+        case INDEX_op_ld32u_i64:
+        case INDEX_op_ld32s_i64:
+        case INDEX_op_ld_i64:
+            if (arg_temp(op->args[1]) == env) {
+                env_load(s, st, op);
+                continue;
+            }
+            /* Any other pointer may point into env */
+            env_read_all(st);
+            break;
+
+        case INDEX_op_st8_i32:
+        case INDEX_op_st16_i32:
+        case INDEX_op_st_i32:
+        case INDEX_op_st8_i64:
+        case INDEX_op_st16_i64:
+        case INDEX_op_st32_i64:
+        case INDEX_op_st_i64:
+            if (arg_temp(op->args[1]) == env) {
+                env_store(s, st, op);
+            } else {
+                st->nb_env = 0;
+            }
+            continue;
+
+        case INDEX_op_st_vec:
+            st->nb_env = 0;
+            continue;
+
+        default:
+            if (vn_pure_op(opc, def)) {
+                vn_pure(s, st, op, def);
+                continue;
+            }
+            /*
+             * Vector loads may read env.  Guest memory accesses may fault,
+             * and their slow path (tlb_fill, or a device model behind
+             * MMIO) may also write env.
+             */
+            if (def->flags & (TCG_OPF_VECTOR | TCG_OPF_SIDE_EFFECTS |
+                              TCG_OPF_CALL_CLOBBER)) {
+                env_read_all(st);
+            }
+            if (def->flags & (TCG_OPF_SIDE_EFFECTS | TCG_OPF_CALL_CLOBBER)) {
+                st->nb_env = 0;
+            }
+            break;
+        }
+
+        nb_oargs = def->nb_oargs;
+        for (i = 0; i < nb_oargs; i++) {
+            vn_new(st, arg_temp(op->args[i]));
+        }
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -1553,4 +1959,6 @@ void tcg_optimize(TCGContext *s)
             prev_mb = op;
         }
     }
+
+    eliminate_redundancy(s);
 }
@@ -36,6 +36,7 @@
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/cacheflush.h"
+#include "qemu/bitmap.h"
 
 /* Note: the long term plan is to reduce the dependencies on the QEMU
    CPU definitions. Currently they are used for qemu_ld/st
@@ -191,6 +192,9 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    unsigned long *evicted; /* regions below .current that are free again */
+    uint64_t *alloc_seq; /* when each region was last allocated */
+    uint64_t seq;
 };
 
 static struct tcg_region_state region;
@@ -286,6 +290,35 @@ static __attribute__((unused)) inline void tcg_patch64(tcg_insn_unit *p,
 }
 #endif
 
+/*
+ * Record a reference from the field at @field of the code being generated
+ * to @value, which is either an absolute host address or any value whose
+ * encoding depends on the position of the code.  This lets the TB cache
+ * move the code of a TB to another place, or to another run of QEMU.
+ */
+static __attribute__((unused)) inline void
+tcg_out_ext_ref(TCGContext *s, void *field, TCGExtRefKind kind,
+                int addend, uintptr_t value)
+{
+#ifdef TCG_TARGET_EXT_REFS
+    TCGExtRef *r;
+
+    if (!s->ext_refs_enabled || s->nb_ext_refs < 0) {
+        return;
+    }
+    if (s->nb_ext_refs == TCG_MAX_EXT_REFS) {
+        /* Too many to relocate this TB, do not cache it */
+        s->nb_ext_refs = -1;
+        return;
+    }
+    r = &s->ext_refs[s->nb_ext_refs++];
+    r->offset = field - (void *)s->code_buf;
+    r->kind = kind;
+    r->addend = addend;
+    r->value = value;
+#endif
+}
+
 /* label relocation processing */
 
 static void tcg_out_reloc(TCGContext *s, tcg_insn_unit *code_ptr, int type,
@@ -507,7 +540,7 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *cp)
+static size_t tc_ptr_to_region_idx(const void *cp)
 {
     void *p = tcg_splitwx_to_rw(cp);
     size_t region_idx;
@@ -523,7 +556,23 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *cp)
             region_idx = offset / region.stride;
         }
     }
-    return region_trees + region_idx * tree_size;
+    return region_idx;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *cp)
+{
+    return region_trees + tc_ptr_to_region_idx(cp) * tree_size;
+}
+
+size_t tcg_nb_regions(void)
+{
+    return region.n;
+}
+
+/* Index of the region that contains the code at @tc_ptr */
+size_t tcg_region_index(const void *tc_ptr)
+{
+    return tc_ptr_to_region_idx(tc_ptr);
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -667,11 +716,20 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t i;
+
+    if (region.current < region.n) {
+        i = region.current++;
+    } else {
+        /* Reuse a region freed by tcg_region_evict() */
+        i = find_first_bit(region.evicted, region.n);
+        if (i == region.n) {
+            return true;
+        }
+        clear_bit(i, region.evicted);
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    region.alloc_seq[i] = ++region.seq;
     return false;
 }
 
@@ -712,6 +770,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -724,6 +783,77 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static gint tcg_region_evict_cmp(gconstpointer a, gconstpointer b,
+                                 gpointer data)
+{
+    const unsigned int *hits = data;
+    size_t ra = *(const size_t *)a;
+    size_t rb = *(const size_t *)b;
+
+    if (hits[ra] != hits[rb]) {
+        return hits[ra] < hits[rb] ? -1 : 1;
+    }
+    return region.alloc_seq[ra] < region.alloc_seq[rb] ? -1 : 1;
+}
+
+/*
+ * Free up to a quarter of the regions, so that TBs can be allocated there
+ * again without flushing all of the code.  The regions with the fewest
+ * @hits go first, and the least recently allocated of those; regions
+ * that a TCG context is filling are kept.  @invalidate is called with
+ * @data on each TB of the evicted regions, which must stop being
+ * reachable; the TBs are then destroyed.
+ *
+ * Returns the number of regions evicted.
+ * Call from a safe-work context.
+ */
+size_t tcg_region_evict(const unsigned int *hits, GTraverseFunc invalidate,
+                        gpointer data)
+{
+    unsigned int n_ctxs = qatomic_read(&n_tcg_ctxs);
+    unsigned long *busy = bitmap_new(region.n);
+    size_t *victims = g_new(size_t, region.n);
+    size_t n_victims = 0;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        set_bit(tc_ptr_to_region_idx(s->code_gen_buffer), busy);
+    }
+    for (i = 0; i < region.current; i++) {
+        if (!test_bit(i, busy) && !test_bit(i, region.evicted)) {
+            victims[n_victims++] = i;
+        }
+    }
+    g_qsort_with_data(victims, n_victims, sizeof(size_t),
+                      tcg_region_evict_cmp, (gpointer)hits);
+    n_victims = MIN(n_victims, MAX(region.n / 4, 1));
+
+    for (i = 0; i < n_victims; i++) {
+        struct tcg_region_tree *rt = region_trees + victims[i] * tree_size;
+        void *start, *end;
+
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, invalidate, data);
+        g_tree_foreach(rt->tree, tcg_region_tree_traverse, NULL);
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(victims[i], &start, &end);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        set_bit(victims[i], region.evicted);
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    g_free(victims);
+    g_free(busy);
+    return n_victims;
+}
+
 #ifdef CONFIG_USER_ONLY
 static size_t tcg_n_regions(void)
 {
@@ -824,6 +954,8 @@ void tcg_region_init(void)
     /* init the region struct */
     qemu_mutex_init(&region.lock);
     region.n = n_regions;
+    region.evicted = bitmap_new(n_regions);
+    region.alloc_seq = g_new0(uint64_t, n_regions);
     region.size = region_size - page_size;
     region.stride = region_size;
     region.start = buf;
@@ -4489,6 +4621,9 @@ void tcg_profile_snapshot(TCGProfile *prof, bool counters, bool table)
             for (i = 0; i < NB_OPS; i++) {
                 PROF_ADD(prof, orig, table_op_count[i]);
             }
+            PROF_ADD(prof, orig, gvn_count);
+            PROF_ADD(prof, orig, load_elim_count);
+            PROF_ADD(prof, orig, store_elim_count);
         }
     }
 }
@@ -4516,6 +4651,9 @@ void tcg_dump_op_count(void)
         qemu_printf("%s %" PRId64 "\n", tcg_op_defs[i].name,
                     prof.table_op_count[i]);
     }
+    qemu_printf("\nredundant ops        %" PRId64 "\n", prof.gvn_count);
+    qemu_printf("redundant env loads  %" PRId64 "\n", prof.load_elim_count);
+    qemu_printf("dead env stores      %" PRId64 "\n", prof.store_elim_count);
 }
 
 int64_t tcg_cpu_exec_time(void)
@@ -4607,7 +4745,10 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #endif
 
 #ifdef USE_TCG_OPTIMIZATIONS
-    tcg_optimize(s);
+    /* Cold TBs are translated quickly, and optimized if they get hot */
+    if (!(tb_cflags(tb) & CF_COLD)) {
+        tcg_optimize(s);
+    }
 #endif
 
 #ifdef CONFIG_PROFILER
@@ -4667,6 +4808,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
 #ifdef TCG_TARGET_NEED_POOL_LABELS
     s->pool_labels = NULL;
 #endif
+#ifdef TCG_TARGET_EXT_REFS
+    s->nb_ext_refs = 0;
+#endif
 
     num_insns = -1;
     QTAILQ_FOREACH(op, &s->ops, link) {
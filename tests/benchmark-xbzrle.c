@@ -0,0 +1,121 @@
+/*
+ * Xor Based Zero Run Length Encoding speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/cutils.h"
+#include "../migration/xbzrle.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+#define XBZRLE_BENCH_PAGES 256
+
+typedef struct XbzrleBenchPattern {
+    const char *name;
+    /* one in @stride bytes is dirtied, in runs of @run_len bytes */
+    int stride;
+    int run_len;
+} XbzrleBenchPattern;
+
+static const XbzrleBenchPattern patterns[] = {
+    { "unchanged",       0,    0 },
+    { "sparse-1B/512B",  512,  1 },
+    { "sparse-8B/256B",  256,  8 },
+    { "counters-4B/64B", 64,   4 },
+    { "runs-64B/128B",   128,  64 },
+    { "dense-1B/2B",     2,    1 },
+};
+
+static void fill_pattern(const XbzrleBenchPattern *pat,
+                         uint8_t *old_buf, uint8_t *new_buf)
+{
+    int i, j;
+
+    for (i = 0; i < XBZRLE_PAGE_SIZE * XBZRLE_BENCH_PAGES; i++) {
+        old_buf[i] = g_test_rand_int();
+    }
+    memcpy(new_buf, old_buf, XBZRLE_PAGE_SIZE * XBZRLE_BENCH_PAGES);
+
+    if (!pat->stride) {
+        return;
+    }
+    for (i = 0; i < XBZRLE_PAGE_SIZE * XBZRLE_BENCH_PAGES; i += pat->stride) {
+        for (j = 0; j < pat->run_len; j++) {
+            new_buf[i + j] = ~old_buf[i + j];
+        }
+    }
+}
+
+static void bench_one(const XbzrleBenchPattern *pat, int accel,
+                      uint8_t *old_buf, uint8_t *new_buf, uint8_t *dst)
+{
+    const size_t total = 1 * GiB;
+    size_t done = 0;
+    double encode, decode;
+    int page = 0;
+    int lens[XBZRLE_BENCH_PAGES];
+
+    g_test_timer_start();
+    while (done < total) {
+        lens[page] = xbzrle_encode_buffer(old_buf + page * XBZRLE_PAGE_SIZE,
+                                          new_buf + page * XBZRLE_PAGE_SIZE,
+                                          XBZRLE_PAGE_SIZE,
+                                          dst + page * XBZRLE_PAGE_SIZE,
+                                          XBZRLE_PAGE_SIZE);
+        page = (page + 1) % XBZRLE_BENCH_PAGES;
+        done += XBZRLE_PAGE_SIZE;
+    }
+    encode = g_test_timer_elapsed();
+
+    done = 0;
+    g_test_timer_start();
+    while (done < total) {
+        if (lens[page] > 0) {
+            xbzrle_decode_buffer(dst + page * XBZRLE_PAGE_SIZE, lens[page],
+                                 old_buf + page * XBZRLE_PAGE_SIZE,
+                                 XBZRLE_PAGE_SIZE);
+        }
+        page = (page + 1) % XBZRLE_BENCH_PAGES;
+        done += XBZRLE_PAGE_SIZE;
+    }
+    decode = g_test_timer_elapsed();
+
+    g_test_message("xbzrle(accel %d) %-16s encode %8.2f MB/sec "
+                   "decode %8.2f MB/sec", accel, pat->name,
+                   total / MiB / encode, total / MiB / decode);
+}
+
+static void test_xbzrle_speed(void)
+{
+    uint8_t *old_buf = g_malloc(XBZRLE_PAGE_SIZE * XBZRLE_BENCH_PAGES);
+    uint8_t *new_buf = g_malloc(XBZRLE_PAGE_SIZE * XBZRLE_BENCH_PAGES);
+    uint8_t *dst = g_malloc(XBZRLE_PAGE_SIZE * XBZRLE_BENCH_PAGES);
+    int accel = 0;
+    int i;
+
+    /*
+     * Accelerator 0 is the best one supported by the host, the last one
+     * is the portable C implementation.
+     */
+    do {
+        for (i = 0; i < ARRAY_SIZE(patterns); i++) {
+            fill_pattern(&patterns[i], old_buf, new_buf);
+            bench_one(&patterns[i], accel, old_buf, new_buf, dst);
+        }
+        accel++;
+    } while (test_xbzrle_encode_buffer_next_accel());
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(dst);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/xbzrle/benchmark/speed", test_xbzrle_speed);
+
+    return g_test_run();
+}
@@ -14,6 +14,7 @@
 #include <math.h>
 #include <fenv.h>
 #include "qemu/timer.h"
+#include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
 /* amortize the computation of random inputs */
@@ -33,6 +34,11 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_MIN,
+    OP_MAX,
+    OP_CVT,
+    OP_TO_INT,
+    OP_FROM_INT,
     OP_MAX_NR,
 };
 
@@ -44,6 +50,11 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_MIN] = "min",
+    [OP_MAX] = "max",
+    [OP_CVT] = "cvt",
+    [OP_TO_INT] = "toInt",
+    [OP_FROM_INT] = "fromInt",
     [OP_MAX_NR] = NULL,
 };
 
@@ -90,6 +101,7 @@ union fp {
     float32 f32;
     float64 f64;
     uint64_t u64;
+    int32_t i32;
 };
 
 struct op_state;
@@ -163,23 +175,35 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * With @int_range, the exponent is replaced so that the operands
+ * fit in an int32_t, and therefore in a float as well.
+ */
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        bool no_neg, bool int_range)
 {
     int i;
 
     for (i = 0; i < n_ops; i++) {
+        uint64_t r = random_ops[i];
+
         switch (prec) {
         case PREC_SINGLE:
         case PREC_FLOAT32:
-            ops[i].f32 = make_float32(random_ops[i]);
+            if (int_range) {
+                r = deposit64(r, 23, 8, 127 + r % 31);
+            }
+            ops[i].f32 = make_float32(r);
             if (no_neg && float32_is_neg(ops[i].f32)) {
                 ops[i].f32 = float32_chs(ops[i].f32);
             }
             break;
         case PREC_DOUBLE:
         case PREC_FLOAT64:
-            ops[i].f64 = make_float64(random_ops[i]);
+            if (int_range) {
+                r = deposit64(r, 52, 11, 1023 + r % 31);
+            }
+            ops[i].f64 = make_float64(r);
             if (no_neg && float64_is_neg(ops[i].f64)) {
                 ops[i].f64 = float64_chs(ops[i].f64);
             }
@@ -194,7 +218,8 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
  * The main benchmark function. Instead of (ab)using macros, we rely
  * on the compiler to unfold this at compile-time.
  */
-static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
+static void bench(enum precision prec, enum op op, int n_ops, bool no_neg,
+                  bool int_range)
 {
     int64_t tf = get_clock() + duration * 1000000000LL;
 
@@ -206,7 +231,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, int_range);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -235,13 +260,28 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MIN:
+                    res.f = fminf(a, b);
+                    break;
+                case OP_MAX:
+                    res.f = fmaxf(a, b);
+                    break;
+                case OP_CVT:
+                    res.d = a;
+                    break;
+                case OP_TO_INT:
+                    res.i32 = a;
+                    break;
+                case OP_FROM_INT:
+                    res.f = ops[0].i32;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, int_range);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -270,13 +310,28 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MIN:
+                    res.d = fmin(a, b);
+                    break;
+                case OP_MAX:
+                    res.d = fmax(a, b);
+                    break;
+                case OP_CVT:
+                    res.f = a;
+                    break;
+                case OP_TO_INT:
+                    res.i32 = a;
+                    break;
+                case OP_FROM_INT:
+                    res.d = ops[0].i32;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, int_range);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
@@ -305,13 +360,28 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MIN:
+                    res.f32 = float32_minnum(a, b, &soft_status);
+                    break;
+                case OP_MAX:
+                    res.f32 = float32_maxnum(a, b, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f64 = float32_to_float64(a, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.i32 = float32_to_int32_round_to_zero(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f32 = int32_to_float32(ops[0].i32, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, int_range);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
@@ -340,6 +410,21 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MIN:
+                    res.f64 = float64_minnum(a, b, &soft_status);
+                    break;
+                case OP_MAX:
+                    res.f64 = float64_maxnum(a, b, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f32 = float64_to_float32(a, &soft_status);
+                    break;
+                case OP_TO_INT:
+                    res.i32 = float64_to_int32_round_to_zero(a, &soft_status);
+                    break;
+                case OP_FROM_INT:
+                    res.f64 = int32_to_float64(ops[0].i32, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -356,13 +441,19 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
 #define GEN_BENCH(name, type, prec, op, n_ops)          \
     static void __attribute__((flatten)) name(void)     \
     {                                                   \
-        bench(prec, op, n_ops, false);                  \
+        bench(prec, op, n_ops, false, false);           \
     }
 
 #define GEN_BENCH_NO_NEG(name, type, prec, op, n_ops)   \
     static void __attribute__((flatten)) name(void)     \
     {                                                   \
-        bench(prec, op, n_ops, true);                   \
+        bench(prec, op, n_ops, true, false);            \
+    }
+
+#define GEN_BENCH_INT_RANGE(name, type, prec, op, n_ops)        \
+    static void __attribute__((flatten)) name(void)             \
+    {                                                           \
+        bench(prec, op, n_ops, false, true);                    \
     }
 
 #define GEN_BENCH_ALL_TYPES(opname, op, n_ops)                          \
@@ -377,6 +468,9 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(min, OP_MIN, 2)
+GEN_BENCH_ALL_TYPES(max, OP_MAX, 2)
+GEN_BENCH_ALL_TYPES(from_int, OP_FROM_INT, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -388,6 +482,17 @@ GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
 GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
 #undef GEN_BENCH_ALL_TYPES_NO_NEG
 
+#define GEN_BENCH_ALL_TYPES_INT_RANGE(name, op, n)                      \
+    GEN_BENCH_INT_RANGE(bench_ ## name ## _float, float, PREC_SINGLE, op, n) \
+    GEN_BENCH_INT_RANGE(bench_ ## name ## _double, double, PREC_DOUBLE, op, n) \
+    GEN_BENCH_INT_RANGE(bench_ ## name ## _float32, float32, PREC_FLOAT32, op, n) \
+    GEN_BENCH_INT_RANGE(bench_ ## name ## _float64, float64, PREC_FLOAT64, op, n)
+
+GEN_BENCH_ALL_TYPES_INT_RANGE(cvt, OP_CVT, 1)
+GEN_BENCH_ALL_TYPES_INT_RANGE(to_int, OP_TO_INT, 1)
+#undef GEN_BENCH_ALL_TYPES_INT_RANGE
+
+#undef GEN_BENCH_INT_RANGE
 #undef GEN_BENCH_NO_NEG
 #undef GEN_BENCH
 
@@ -407,6 +512,11 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(min, OP_MIN),
+    GEN_BENCH_FUNCS(max, OP_MAX),
+    GEN_BENCH_FUNCS(cvt, OP_CVT),
+    GEN_BENCH_FUNCS(to_int, OP_TO_INT),
+    GEN_BENCH_FUNCS(from_int, OP_FROM_INT),
 };
 
 #undef GEN_BENCH_FUNCS
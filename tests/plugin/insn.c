@@ -19,11 +19,31 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
 static uint64_t insn_count;
 static bool do_inline;
 
+/*
+ * In sampling mode each vCPU counts its instructions inline, and a
+ * conditional callback fires every sample_period instructions.
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t samples;
+} SampleCount;
+
+static uint64_t sample_period;
+static struct qemu_plugin_scoreboard *sample_counts;
+static qemu_plugin_u64 sample_count;
+static qemu_plugin_u64 sample_samples;
+
 static void vcpu_insn_exec_before(unsigned int cpu_index, void *udata)
 {
     insn_count++;
 }
 
+static void vcpu_insn_sample(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_set(sample_count, cpu_index, 0);
+    qemu_plugin_u64_add(sample_samples, cpu_index, 1);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     size_t n = qemu_plugin_tb_n_insns(tb);
@@ -32,7 +52,13 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
     for (i = 0; i < n; i++) {
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
 
-        if (do_inline) {
+        if (sample_period) {
+            qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+                insn, QEMU_PLUGIN_INLINE_ADD_U64, sample_count, 1);
+            qemu_plugin_register_vcpu_insn_exec_cond_cb(
+                insn, vcpu_insn_sample, QEMU_PLUGIN_CB_NO_REGS,
+                QEMU_PLUGIN_COND_GE, sample_count, sample_period, NULL);
+        } else if (do_inline) {
             qemu_plugin_register_vcpu_insn_exec_inline(
                 insn, QEMU_PLUGIN_INLINE_ADD_U64, &insn_count, 1);
         } else {
@@ -44,7 +70,18 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
 static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
-    g_autofree gchar *out = g_strdup_printf("insns: %" PRIu64 "\n", insn_count);
+    g_autofree gchar *out = NULL;
+
+    if (sample_period) {
+        uint64_t samples = qemu_plugin_u64_sum(sample_samples);
+
+        out = g_strdup_printf("insns: %" PRIu64 "\n",
+                              samples * sample_period +
+                              qemu_plugin_u64_sum(sample_count));
+        qemu_plugin_scoreboard_free(sample_counts);
+    } else {
+        out = g_strdup_printf("insns: %" PRIu64 "\n", insn_count);
+    }
     qemu_plugin_outs(out);
 }
 
@@ -54,6 +91,16 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
 {
     if (argc && !strcmp(argv[0], "inline")) {
         do_inline = true;
+    } else if (argc && g_str_has_prefix(argv[0], "sample=")) {
+        sample_period = g_ascii_strtoull(argv[0] + strlen("sample="), NULL, 0);
+    }
+
+    if (sample_period) {
+        sample_counts = qemu_plugin_scoreboard_new(sizeof(SampleCount));
+        sample_count = qemu_plugin_scoreboard_u64_in_struct(
+            sample_counts, SampleCount, count);
+        sample_samples = qemu_plugin_scoreboard_u64_in_struct(
+            sample_counts, SampleCount, samples);
     }
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
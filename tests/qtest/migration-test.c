@@ -1266,7 +1266,22 @@ static void test_migrate_auto_converge(void)
     test_migrate_end(from, to, true);
 }
 
-static void test_multifd_tcp(const char *method)
+/*
+ * Fill the pages at the start of the test area with the same content.
+ * The first byte of each page is left alone, check_guests_ram() needs
+ * the values that the guest puts there.
+ */
+static void fill_guest_pages_repeated(QTestState *who, unsigned size)
+{
+    unsigned address;
+
+    for (address = start_address; address < start_address + size;
+         address += TEST_MEM_PAGE_SIZE) {
+        qtest_memset(who, address + 1, 0x5a, TEST_MEM_PAGE_SIZE - 1);
+    }
+}
+
+static void test_multifd_tcp(const char *method, bool dedup, bool zero_copy)
 {
     MigrateStart *args = migrate_start_new();
     QTestState *from, *to;
@@ -1296,6 +1311,14 @@ static void test_multifd_tcp(const char *method)
     migrate_set_capability(from, "multifd", "true");
     migrate_set_capability(to, "multifd", "true");
 
+    if (dedup) {
+        migrate_set_capability(from, "multifd-dedup", "true");
+        migrate_set_capability(to, "multifd-dedup", "true");
+    }
+    if (zero_copy) {
+        migrate_set_capability(from, "zero-copy-send", "true");
+    }
+
     /* Start incoming migration from the 1st socket */
     rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
                            "  'arguments': { 'uri': 'tcp:127.0.0.1:0' }}");
@@ -1304,6 +1327,10 @@ static void test_multifd_tcp(const char *method)
     /* Wait for the first serial output from the source */
     wait_for_serial("src_serial");
 
+    if (dedup) {
+        fill_guest_pages_repeated(from, 16 * 1024 * 1024);
+    }
+
     uri = migrate_get_socket_address(to, "socket-address");
 
     migrate_qmp(from, uri, "{}");
@@ -1319,27 +1346,152 @@ static void test_multifd_tcp(const char *method)
 
     wait_for_serial("dest_serial");
     wait_for_migration_complete(from);
+
+    if (dedup) {
+        int64_t dedup_pages = read_ram_property_int(from, "dedup-pages");
+        int64_t page_size = read_ram_property_int(from, "page-size");
+
+        g_assert_cmpint(dedup_pages, >, 0);
+        g_assert_cmpint(read_ram_property_int(from, "dedup-bytes"), ==,
+                        dedup_pages * page_size);
+    }
+
     test_migrate_end(from, to, true);
     g_free(uri);
 }
 
 static void test_multifd_tcp_none(void)
 {
-    test_multifd_tcp("none");
+    test_multifd_tcp("none", false, false);
+}
+
+static void test_multifd_tcp_dedup(void)
+{
+    /*
+     * The guest only dirties the first byte of each page, and the test
+     * fills the rest of the first pages with the same pattern, so most of
+     * the pages sent are identical to another one.
+     */
+    test_multifd_tcp("none", true, false);
 }
 
 static void test_multifd_tcp_zlib(void)
 {
-    test_multifd_tcp("zlib");
+    test_multifd_tcp("zlib", false, false);
 }
 
 #ifdef CONFIG_ZSTD
 static void test_multifd_tcp_zstd(void)
 {
-    test_multifd_tcp("zstd");
+    test_multifd_tcp("zstd", false, false);
 }
 #endif
 
+#ifdef CONFIG_LINUX
+/* zero-copy-send needs MSG_ZEROCOPY support from the kernel */
+static bool zero_copy_send_supported(void)
+{
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int v = 1;
+    bool ret;
+
+    if (fd < 0) {
+        return false;
+    }
+    ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == 0;
+    close(fd);
+    return ret;
+#else
+    return false;
+#endif
+}
+
+static void test_multifd_tcp_zero_copy(void)
+{
+    if (!zero_copy_send_supported()) {
+        g_test_skip("MSG_ZEROCOPY is not supported");
+        return;
+    }
+    test_multifd_tcp("none", false, true);
+}
+#endif
+
+/*
+ * Save the source with multifd channels writing the pages at their place
+ * in a file, then load the file on the target; with @postcopy the target
+ * starts before its RAM is loaded.  The layout of the file does not depend
+ * on the channels that wrote it, so a target without multifd
+ * (@dst_multifd false) loads it as well.
+ */
+static void do_test_multifd_file_mapped_ram(bool postcopy, bool dst_multifd)
+{
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+    QDict *rsp;
+    g_autofree char *uri = g_strdup_printf("file:%s/migfile", tmpfs);
+
+    if (test_migrate_start(&from, &to, "defer", args)) {
+        return;
+    }
+
+    migrate_set_parameter_int(from, "downtime-limit", CONVERGE_DOWNTIME);
+    /* 1GB/s */
+    migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+
+    migrate_set_parameter_int(from, "multifd-channels", 4);
+    migrate_set_capability(from, "multifd", "true");
+    if (dst_multifd) {
+        migrate_set_parameter_int(to, "multifd-channels", 4);
+        migrate_set_capability(to, "multifd", "true");
+    }
+
+    migrate_set_capability(from, "mapped-ram", "true");
+    migrate_set_capability(to, "mapped-ram", "true");
+    if (postcopy) {
+        migrate_set_capability(to, "postcopy-from-file", "true");
+    }
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, uri, "{}");
+
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+    wait_for_migration_complete(from);
+
+    rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
+                           "  'arguments': { 'uri': %s }}", uri);
+    qobject_unref(rsp);
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    if (postcopy) {
+        /* Completes once the rest of RAM is loaded in the background */
+        wait_for_migration_complete(to);
+    }
+    test_migrate_end(from, to, true);
+    cleanup("migfile");
+}
+
+static void test_multifd_file_mapped_ram(void)
+{
+    do_test_multifd_file_mapped_ram(false, true);
+}
+
+static void test_multifd_file_mapped_ram_dst_single(void)
+{
+    do_test_multifd_file_mapped_ram(false, false);
+}
+
+static void test_multifd_file_mapped_ram_postcopy(void)
+{
+    do_test_multifd_file_mapped_ram(true, true);
+}
+
 /*
  * This test does:
  *  source               target
@@ -1502,8 +1654,19 @@ int main(int argc, char **argv)
 
     qtest_add_func("/migration/auto_converge", test_migrate_auto_converge);
     qtest_add_func("/migration/multifd/tcp/none", test_multifd_tcp_none);
+    qtest_add_func("/migration/multifd/tcp/dedup", test_multifd_tcp_dedup);
     qtest_add_func("/migration/multifd/tcp/cancel", test_multifd_tcp_cancel);
     qtest_add_func("/migration/multifd/tcp/zlib", test_multifd_tcp_zlib);
+#ifdef CONFIG_LINUX
+    qtest_add_func("/migration/multifd/tcp/zero-copy",
+                   test_multifd_tcp_zero_copy);
+#endif
+    qtest_add_func("/migration/multifd/file/mapped-ram",
+                   test_multifd_file_mapped_ram);
+    qtest_add_func("/migration/multifd/file/mapped-ram/dst-single",
+                   test_multifd_file_mapped_ram_dst_single);
+    qtest_add_func("/migration/multifd/file/mapped-ram/postcopy",
+                   test_multifd_file_mapped_ram_postcopy);
 #ifdef CONFIG_ZSTD
     qtest_add_func("/migration/multifd/tcp/zstd", test_multifd_tcp_zstd);
 #endif
@@ -766,6 +766,96 @@ static void resize(void *obj, void *data, QGuestAllocator *t_alloc)
 
 }
 
+/* Submit a request of the 3 descriptor layout on @vq and wait for it */
+static uint64_t submit_and_wait(QVirtioDevice *dev, QGuestAllocator *alloc,
+                                QVirtQueue *vq, QVirtioBlkReq *req)
+{
+    QTestState *qts = global_qtest;
+    bool write = req->type == VIRTIO_BLK_T_OUT;
+    uint64_t req_addr;
+    uint32_t free_head;
+
+    req_addr = virtio_blk_request(alloc, dev, req, 512);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512, !write, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    g_assert_cmpint(readb(req_addr + 528), ==, 0);
+    return req_addr;
+}
+
+/* With iothread-vq-mapping, write on one virtqueue and read on another */
+static void iothread_vq_mapping(void *obj, void *data,
+                                QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtioDevice *dev = blk_if->vdev;
+    QVirtQueue *vq[4];
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    uint64_t features;
+    char *buf;
+    int i;
+
+    features = qvirtio_get_features(dev);
+    g_assert(features & (1u << VIRTIO_BLK_F_MQ));
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                    (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                    (1u << VIRTIO_RING_F_EVENT_IDX) |
+                    (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    g_assert_cmpint(qvirtio_config_readw(dev,
+                        offsetof(struct virtio_blk_config, num_queues)),
+                    ==, 4);
+
+    for (i = 0; i < 4; i++) {
+        vq[i] = qvirtqueue_setup(dev, t_alloc, i);
+    }
+    qvirtio_set_driver_ok(dev);
+
+    for (i = 0; i < 4; i++) {
+        /* Write request */
+        req.type = VIRTIO_BLK_T_OUT;
+        req.ioprio = 1;
+        req.sector = i;
+        req.data = g_malloc0(512);
+        sprintf(req.data, "TEST%d", i);
+
+        req_addr = submit_and_wait(dev, t_alloc, vq[i], &req);
+        g_free(req.data);
+        guest_free(t_alloc, req_addr);
+    }
+
+    for (i = 0; i < 4; i++) {
+        g_autofree char *expected = g_strdup_printf("TEST%d", i);
+
+        /* Read request, on the virtqueue of another IOThread */
+        req.type = VIRTIO_BLK_T_IN;
+        req.ioprio = 1;
+        req.sector = i;
+        req.data = g_malloc0(512);
+
+        req_addr = submit_and_wait(dev, t_alloc, vq[(i + 1) % 4], &req);
+        g_free(req.data);
+
+        buf = g_malloc0(512);
+        memread(req_addr + 16, buf, 512);
+        g_assert_cmpstr(buf, ==, expected);
+        g_free(buf);
+
+        guest_free(t_alloc, req_addr);
+    }
+
+    for (i = 0; i < 4; i++) {
+        qvirtqueue_cleanup(dev->bus, vq[i], t_alloc);
+    }
+}
+
 static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
 {
     char *tmp_path = drive_create();
@@ -780,6 +870,14 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_blk_setup_iothreads(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -object iothread,id=io0"
+                    " -object iothread,id=io1 ");
+    return virtio_blk_test_setup(cmd_line, arg);
+}
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
@@ -797,6 +895,13 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    opts.before = virtio_blk_setup_iothreads;
+    opts.edge = (QOSGraphEdgeOptions) {
+        .extra_device_opts = "num-queues=4,iothread-vq-mapping=io0:io1",
+    };
+    qos_add_test("iothread-vq-mapping", "virtio-blk-pci",
+                 iothread_vq_mapping, &opts);
 }
 
 libqos_init(register_virtio_blk_test);
@@ -0,0 +1,402 @@
+/*
+ * Benchmark for the handling of guest writes to pages that contain code
+ *
+ * Each page has a list of TBs, protected by a lock, and a bitmap of the
+ * bytes that they cover.  Writer threads store to the pages, and
+ * invalidate the TBs that they hit; with the given update rate, a store
+ * is instead the translation of a new TB in the page.
+ *
+ * By default a store checks the bitmap under RCU and only takes the page
+ * lock if it hits a TB, as in tb_invalidate_phys_page_unneeded().  With
+ * -L, every store builds a page collection and takes the page lock first,
+ * as in page_collection_lock().
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/processor.h"
+#include "qemu/atomic.h"
+#include "qemu/bitmap.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+
+#define PAGE_BITS       12
+#define PAGE_SIZE       (1 << PAGE_BITS)
+#define MAX_PAGE_TBS    64
+#define MIN_TB_SIZE     16
+#define MAX_TB_SIZE     256
+
+struct thread_stats {
+    size_t clean;
+    size_t inval;
+    size_t tb_inval;
+    size_t tb_add;
+};
+
+struct thread_info {
+    struct thread_stats stats;
+    uint64_t seed;
+    unsigned int first_page;
+} QEMU_ALIGNED(64); /* avoid false sharing among threads */
+
+typedef struct PageBitmap {
+    struct rcu_head rcu;
+    unsigned long bits[BITS_TO_LONGS(PAGE_SIZE)];
+} PageBitmap;
+
+struct page {
+    QemuSpin lock;
+    PageBitmap *bitmap;
+    unsigned int n_tbs;
+    uint16_t tb_start[MAX_PAGE_TBS];
+    uint16_t tb_end[MAX_PAGE_TBS];
+} QEMU_ALIGNED(64);
+
+static struct page *pages;
+static QemuThread *threads;
+static struct thread_info *info;
+
+static unsigned int duration = 1;
+static unsigned int n_threads = 1;
+static unsigned int pages_per_thread = 1;
+static unsigned int n_pages;
+static unsigned int init_tbs = 8;
+static bool shared_pages;
+static bool use_locks;
+static double update_rate; /* 0.0 to 1.0 */
+static uint64_t update_threshold;
+
+static size_t n_ready_threads;
+static bool test_start;
+static bool test_stop;
+
+static const char commands_string[] =
+    " -d = duration, in seconds\n"
+    " -n = number of threads\n"
+    " -p = number of pages per thread\n"
+    " -s = threads write to all the pages, not only to their own\n"
+    " -t = initial number of TBs per page\n"
+    " -u = rate of stores that translate a TB instead (0.0 to 100.0)\n"
+    " -L = take the page lock on every store";
+
+static void usage_complete(int argc, char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+    exit(-1);
+}
+
+/*
+ * From: https://en.wikipedia.org/wiki/Xorshift
+ * This is faster than rand_r(), and gives us a wider range (RAND_MAX is only
+ * guaranteed to be >= INT_MAX).
+ */
+static uint64_t xorshift64star(uint64_t x)
+{
+    x ^= x >> 12; /* a */
+    x ^= x << 25; /* b */
+    x ^= x >> 27; /* c */
+    return x * UINT64_C(2685821657736338717);
+}
+
+/* Call with @pg->lock held */
+static void page_rebuild_bitmap(struct page *pg)
+{
+    PageBitmap *bm = g_new0(PageBitmap, 1);
+    PageBitmap *old = pg->bitmap;
+    unsigned int i;
+
+    for (i = 0; i < pg->n_tbs; i++) {
+        bitmap_set(bm->bits, pg->tb_start[i],
+                   pg->tb_end[i] - pg->tb_start[i]);
+    }
+    qatomic_rcu_set(&pg->bitmap, bm);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
+/* Call with @pg->lock held */
+static void page_add_tb(struct page *pg, unsigned int start, unsigned int end)
+{
+    if (pg->n_tbs == MAX_PAGE_TBS) {
+        memmove(&pg->tb_start[0], &pg->tb_start[1],
+                sizeof(uint16_t) * (MAX_PAGE_TBS - 1));
+        memmove(&pg->tb_end[0], &pg->tb_end[1],
+                sizeof(uint16_t) * (MAX_PAGE_TBS - 1));
+        pg->n_tbs--;
+        page_rebuild_bitmap(pg);
+    }
+    pg->tb_start[pg->n_tbs] = start;
+    pg->tb_end[pg->n_tbs] = end;
+    pg->n_tbs++;
+    bitmap_set_atomic(pg->bitmap->bits, start, end - start);
+}
+
+/*
+ * Call with @pg->lock held, after a store hit the bitmap; return the number
+ * of TBs invalidated.  The bitmap is rebuilt even if none was, as in
+ * tb_invalidate_phys_page_range__locked(), which drops stale bits that way.
+ */
+static size_t page_invalidate(struct page *pg, unsigned int start,
+                              unsigned int end)
+{
+    unsigned int i, j;
+
+    for (i = j = 0; i < pg->n_tbs; i++) {
+        if (pg->tb_end[i] <= start || pg->tb_start[i] >= end) {
+            pg->tb_start[j] = pg->tb_start[i];
+            pg->tb_end[j] = pg->tb_end[i];
+            j++;
+        }
+    }
+    pg->n_tbs = j;
+    page_rebuild_bitmap(pg);
+    return i - j;
+}
+
+static bool page_bitmap_hit(struct page *pg, unsigned int start,
+                            unsigned int end)
+{
+    PageBitmap *bm = qatomic_rcu_read(&pg->bitmap);
+
+    return find_next_bit(bm->bits, end, start) < end;
+}
+
+static gint tree_cmp(gconstpointer a, gconstpointer b, gpointer data)
+{
+    return GPOINTER_TO_UINT(a) - GPOINTER_TO_UINT(b);
+}
+
+static void do_store(struct thread_info *info, struct page *pg,
+                     unsigned int start)
+{
+    struct thread_stats *stats = &info->stats;
+    unsigned int end = start + sizeof(uint64_t);
+    size_t n = 0;
+
+    if (use_locks) {
+        GTree *tree = g_tree_new_full(tree_cmp, NULL, NULL, NULL);
+
+        g_tree_insert(tree, GUINT_TO_POINTER(pg - pages), pg);
+        qemu_spin_lock(&pg->lock);
+        if (page_bitmap_hit(pg, start, end)) {
+            n = page_invalidate(pg, start, end);
+        }
+        qemu_spin_unlock(&pg->lock);
+        g_tree_destroy(tree);
+    } else if (page_bitmap_hit(pg, start, end)) {
+        qemu_spin_lock(&pg->lock);
+        n = page_invalidate(pg, start, end);
+        qemu_spin_unlock(&pg->lock);
+    }
+
+    if (n) {
+        stats->inval++;
+        stats->tb_inval += n;
+    } else {
+        stats->clean++;
+    }
+}
+
+static void do_translate(struct thread_info *info, struct page *pg,
+                         uint64_t r)
+{
+    unsigned int size = MIN_TB_SIZE + (r >> 32) % (MAX_TB_SIZE - MIN_TB_SIZE);
+    unsigned int start = (r >> 16) % (PAGE_SIZE - size);
+
+    qemu_spin_lock(&pg->lock);
+    page_add_tb(pg, start, start + size);
+    qemu_spin_unlock(&pg->lock);
+    info->stats.tb_add++;
+}
+
+static void do_op(struct thread_info *info)
+{
+    uint64_t r = info->seed - 1;
+    struct page *pg;
+
+    if (shared_pages) {
+        pg = &pages[(r >> 40) % n_pages];
+    } else {
+        pg = &pages[info->first_page + (r >> 40) % pages_per_thread];
+    }
+
+    if (r < update_threshold) {
+        do_translate(info, pg, xorshift64star(r));
+    } else {
+        do_store(info, pg, r & (PAGE_SIZE - 1) & -sizeof(uint64_t));
+    }
+}
+
+static void *thread_func(void *p)
+{
+    struct thread_info *info = p;
+
+    rcu_register_thread();
+
+    qatomic_inc(&n_ready_threads);
+    while (!qatomic_read(&test_start)) {
+        cpu_relax();
+    }
+
+    while (!qatomic_read(&test_stop)) {
+        info->seed = xorshift64star(info->seed);
+        rcu_read_lock();
+        do_op(info);
+        rcu_read_unlock();
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void pages_init(void)
+{
+    uint64_t r = time(NULL);
+    unsigned int i, j;
+
+    n_pages = n_threads * pages_per_thread;
+    pages = qemu_memalign(64, sizeof(*pages) * n_pages);
+    memset(pages, 0, sizeof(*pages) * n_pages);
+
+    for (i = 0; i < n_pages; i++) {
+        struct page *pg = &pages[i];
+
+        qemu_spin_init(&pg->lock);
+        page_rebuild_bitmap(pg);
+        for (j = 0; j < init_tbs; j++) {
+            r = xorshift64star(r);
+            do_translate(&(struct thread_info){}, pg, r);
+        }
+    }
+}
+
+static void create_threads(void)
+{
+    unsigned int i;
+
+    threads = g_malloc(sizeof(*threads) * n_threads);
+    info = qemu_memalign(64, sizeof(*info) * n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        /* seed for the RNG; each thread should have a different one */
+        info[i].seed = (i + 1) ^ time(NULL);
+        info[i].first_page = i * pages_per_thread;
+        memset(&info[i].stats, 0, sizeof(info[i].stats));
+        qemu_thread_create(&threads[i], "smc", thread_func, &info[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" duration:          %d s\n", duration);
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" pages per thread:  %u\n", pages_per_thread);
+    printf(" shared pages:      %s\n", shared_pages ? "yes" : "no");
+    printf(" initial TBs/page:  %u\n", init_tbs);
+    printf(" update rate:       %f%%\n", update_rate * 100.0);
+    printf(" lock every store:  %s\n", use_locks ? "yes" : "no");
+}
+
+static void pr_stats(void)
+{
+    struct thread_stats s = {};
+    unsigned int i;
+    double tx;
+
+    for (i = 0; i < n_threads; i++) {
+        s.clean += info[i].stats.clean;
+        s.inval += info[i].stats.inval;
+        s.tb_inval += info[i].stats.tb_inval;
+        s.tb_add += info[i].stats.tb_add;
+    }
+
+    printf("Results:\n");
+    printf(" Stores:            %.2f M (%.2f%% hit code)\n",
+           (double)(s.clean + s.inval) / 1e6,
+           (double)s.inval / (s.clean + s.inval) * 100);
+    printf(" TBs invalidated:   %.2f M\n", (double)s.tb_inval / 1e6);
+    printf(" TBs translated:    %.2f M\n", (double)s.tb_add / 1e6);
+
+    tx = (s.clean + s.inval + s.tb_add) / 1e6 / duration;
+    printf(" Throughput:        %.2f MT/s\n", tx);
+    printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_threads);
+}
+
+static void run_test(void)
+{
+    unsigned int i;
+
+    while (qatomic_read(&n_ready_threads) != n_threads) {
+        cpu_relax();
+    }
+
+    qatomic_set(&test_start, true);
+    g_usleep(duration * G_USEC_PER_SEC);
+    qatomic_set(&test_stop, true);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "d:hn:p:st:u:L");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'h':
+            usage_complete(argc, argv);
+            exit(0);
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        case 'p':
+            pages_per_thread = MAX(atoi(optarg), 1);
+            break;
+        case 's':
+            shared_pages = true;
+            break;
+        case 't':
+            init_tbs = MIN(atoi(optarg), MAX_PAGE_TBS);
+            break;
+        case 'u':
+            update_rate = atof(optarg) / 100.0;
+            if (update_rate > 1.0) {
+                update_rate = 1.0;
+            }
+            break;
+        case 'L':
+            use_locks = true;
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    if (update_rate == 1.0) {
+        update_threshold = UINT64_MAX;
+    } else {
+        update_threshold = update_rate * 0x1p64;
+    }
+    pages_init();
+    pr_params();
+    create_threads();
+    run_test();
+    pr_stats();
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Tiered translation exerciser
+ *
+ * Run a few hot loops, with branches inside them and calls between
+ * them, long enough for their TBs to be retranslated in the background
+ * while the vCPUs keep running them.  The results are checked against
+ * values computed in closed form, so that a hot TB that does not behave
+ * like its cold version is caught.  One thread per loop makes the
+ * retranslation race with the execution of the TB on another vCPU.
+ *
+ * Run it with a low -tier threshold; without it this is a plain loop test.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define ITERATIONS 2000000
+
+static uint64_t __attribute__((noinline)) sum_odd_even(uint64_t n)
+{
+    uint64_t sum = 0;
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        if (i & 1) {
+            sum += i;
+        } else {
+            sum -= i / 2;
+        }
+    }
+    return sum;
+}
+
+static uint64_t expected_odd_even(uint64_t n)
+{
+    uint64_t odd = n / 2;            /* 1, 3, ..., 2 * odd - 1 */
+    uint64_t even = (n + 1) / 2;     /* 0, 2, ..., 2 * (even - 1) */
+
+    return odd * odd - even * (even - 1) / 2;
+}
+
+static uint32_t __attribute__((noinline)) step(uint32_t x)
+{
+    return x * 1103515245u + 12345u;
+}
+
+static uint32_t __attribute__((noinline)) lcg(uint32_t x, uint64_t n)
+{
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        x = step(x);
+    }
+    return x;
+}
+
+/* The same sequence by squaring, which runs far fewer TBs */
+static uint32_t expected_lcg(uint32_t x, uint64_t n)
+{
+    uint32_t mul = 1103515245u, add = 12345u;
+
+    while (n) {
+        if (n & 1) {
+            x = x * mul + add;
+        }
+        add = add * mul + add;
+        mul *= mul;
+        n >>= 1;
+    }
+    return x;
+}
+
+static void *odd_even_thread(void *arg)
+{
+    uintptr_t bad = sum_odd_even(ITERATIONS) != expected_odd_even(ITERATIONS);
+
+    return (void *)bad;
+}
+
+static void *lcg_thread(void *arg)
+{
+    uintptr_t bad = lcg(1, ITERATIONS) != expected_lcg(1, ITERATIONS);
+
+    return (void *)bad;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[2];
+    void *bad[2];
+    int errors = 0;
+    int i;
+
+    /* Single-threaded first, so that the first vCPU gets the hot TBs */
+    if (sum_odd_even(ITERATIONS) != expected_odd_even(ITERATIONS)) {
+        fprintf(stderr, "sum_odd_even: wrong result\n");
+        errors++;
+    }
+    if (lcg(1, ITERATIONS) != expected_lcg(1, ITERATIONS)) {
+        fprintf(stderr, "lcg: wrong result\n");
+        errors++;
+    }
+
+    pthread_create(&threads[0], NULL, odd_even_thread, NULL);
+    pthread_create(&threads[1], NULL, lcg_thread, NULL);
+    for (i = 0; i < 2; i++) {
+        pthread_join(threads[i], &bad[i]);
+        if (bad[i]) {
+            fprintf(stderr, "thread %d: wrong result\n", i);
+            errors++;
+        }
+    }
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/*
+ * CPU state held in env across MMIO accesses
+ *
+ * The SSE registers live in env, and the translator reads and writes
+ * them with plain loads and stores from env, which the optimizer may
+ * forward or drop within a TB.  An MMIO access goes through the device
+ * model, which may change the CPU state (the local APIC may report a TPR
+ * access, which restores the guest state of the vCPU), so nothing may be
+ * forwarded across it.
+ *
+ * Each round keeps a value in %xmm0 while accessing the TPR of the local
+ * APIC, all in one TB, and checks the register and the TPR afterwards.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <minilib.h>
+
+#define APIC_BASE   0xfee00000UL
+#define APIC_TPR    0x80
+#define ROUNDS      1000
+
+#define CR0_MP      (1 << 1)
+#define CR0_EM      (1 << 2)
+#define CR4_OSFXSR  (1 << 9)
+
+static void enable_sse(void)
+{
+    uint64_t cr0, cr4;
+
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~CR0_EM) | CR0_MP;
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR;
+    asm volatile("mov %0, %%cr4" : : "r"(cr4));
+}
+
+static bool test_round(volatile uint32_t *tpr, uint64_t val, uint32_t prio,
+                       int round)
+{
+    uint64_t before, after, doubled;
+    uint32_t prio_read;
+
+    asm volatile("movq %[val], %%xmm0\n\t"
+                 "movq %%xmm0, %[before]\n\t"
+                 "movl %[prio], (%[tpr])\n\t"
+                 "movq %%xmm0, %[after]\n\t"
+                 "movl (%[tpr]), %[prio_read]\n\t"
+                 "paddq %%xmm0, %%xmm0\n\t"
+                 "movq %%xmm0, %[doubled]\n\t"
+                 : [before] "=&r"(before), [after] "=&r"(after),
+                   [doubled] "=&r"(doubled), [prio_read] "=&r"(prio_read)
+                 : [val] "r"(val), [prio] "r"(prio), [tpr] "r"(tpr)
+                 : "xmm0", "memory");
+
+    if (before != val || after != val || doubled != val * 2) {
+        ml_printf("round %d: xmm0 0x%lx, 0x%lx, 0x%lx, expected 0x%lx\n",
+                  round, before, after, doubled, val);
+        return false;
+    }
+    if (prio_read != prio) {
+        ml_printf("round %d: TPR 0x%x, expected 0x%x\n",
+                  round, prio_read, prio);
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    volatile uint32_t *tpr = (volatile uint32_t *)(APIC_BASE + APIC_TPR);
+    uint64_t val = 0x0123456789abcdefULL;
+    bool ok = true;
+    int round;
+
+    enable_sse();
+
+    for (round = 0; ok && round < ROUNDS; round++) {
+        ok = test_round(tpr, val, (round & 0xf) << 4, round);
+        val = val * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    *tpr = 0;
+
+    ml_printf("Test complete: %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,137 @@
+/*
+ * Self-modifying code, system test version
+ *
+ * Guest code that keeps its data in the pages of its code, as JITs do,
+ * and patches that code between calls.  The stores next to the code
+ * must not change what runs, and every patch must be seen by the next
+ * call.  Once a page has taken enough of those stores it gets a code
+ * bitmap, which then decides which stores invalidate TBs:
+ *
+ *   - a function within one page, with data stored next to it
+ *   - a function that spans two pages, patched through its first page
+ *     only, after which the data stored in the second page lands where
+ *     the removed TB used to be
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <minilib.h>
+
+#define MEM_PAGE_SIZE 4096
+#define ROUNDS 200
+#define STORES 64
+
+/* mov $imm32, %eax; ret */
+#define INSN_LEN 6
+
+typedef uint32_t (*jit_fn)(void);
+
+__attribute__((aligned(MEM_PAGE_SIZE)))
+static volatile uint8_t jit_pages[MEM_PAGE_SIZE * 2];
+
+static void emit_ret_imm(volatile uint8_t *p, uint32_t imm)
+{
+    int i;
+
+    p[0] = 0xb8;
+    for (i = 0; i < 4; i++) {
+        p[1 + i] = imm >> (i * 8);
+    }
+    p[5] = 0xc3;
+}
+
+static void patch_imm(volatile uint8_t *p, uint32_t imm)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        p[1 + i] = imm >> (i * 8);
+    }
+}
+
+static bool check_call(const char *what, volatile uint8_t *code,
+                       uint32_t expected, int round)
+{
+    uint32_t got = ((jit_fn)code)();
+
+    if (got != expected) {
+        ml_printf("%s: round %d: got 0x%x, expected 0x%x\n",
+                  what, round, got, expected);
+        return false;
+    }
+    return true;
+}
+
+static bool store_data(const char *what, volatile uint8_t *data, int round)
+{
+    int i;
+
+    for (i = 0; i < STORES; i++) {
+        data[i] = round + i;
+    }
+    for (i = 0; i < STORES; i++) {
+        if (data[i] != (uint8_t)(round + i)) {
+            ml_printf("%s: round %d: data lost at %d\n", what, round, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_one_page(void)
+{
+    volatile uint8_t *code = jit_pages + 128;
+    volatile uint8_t *data = jit_pages + MEM_PAGE_SIZE / 2;
+    int round;
+
+    emit_ret_imm(code, 0);
+    for (round = 0; round < ROUNDS; round++) {
+        if (!store_data("one page", data, round) ||
+            !check_call("one page", code, round, round)) {
+            return false;
+        }
+        patch_imm(code, round + 1);
+        if (!check_call("one page patched", code, round + 1, round)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_two_pages(void)
+{
+    /* The opcode and the first byte of the immediate in the first page */
+    volatile uint8_t *code = jit_pages + MEM_PAGE_SIZE - 2;
+    volatile uint8_t *tail = jit_pages + MEM_PAGE_SIZE;
+    int round;
+
+    for (round = 0; round < ROUNDS; round++) {
+        uint32_t imm = 0x01010101u * (round + 1);
+
+        emit_ret_imm(code, imm);
+        if (!check_call("two pages", code, imm, round)) {
+            return false;
+        }
+        /* Removes the TB from both pages, through the first one */
+        code[1] = 0xa5;
+        /* Plain data where the end of the TB was */
+        if (!store_data("two pages", tail, round)) {
+            return false;
+        }
+        emit_ret_imm(code, ~imm);
+        if (!check_call("two pages rewritten", code, ~imm, round)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    bool ok;
+
+    ok = test_one_page() && test_two_pages();
+
+    ml_printf("Test complete: %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : -1;
+}
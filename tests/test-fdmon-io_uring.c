@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * fdmon-io_uring tests
+ *
+ * Requests that other AioContext users add to the ring with
+ * aio_uring_get_sqe() must keep working in IOThreads, which have a GSource
+ * that glib never runs, and must not be lost when glib starts running an
+ * AioContext and fdmon-io_uring gives way to fdmon-poll.
+ */
+
+#include "qemu/osdep.h"
+#include <liburing.h>
+#include "block/aio.h"
+#include "block/aio-wait.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "iothread.h"
+
+typedef struct {
+    AioUringRequest req;
+    bool submitted;
+    bool done;
+} NopRequest;
+
+static bool have_fdmon_io_uring;
+
+static void nop_cb(AioUringRequest *req)
+{
+    NopRequest *nop = container_of(req, NopRequest, req);
+
+    g_assert_cmpint(req->res, ==, 0);
+    nop->done = true;
+}
+
+/* Returns false if @ctx has no ring to share */
+static bool submit_nop(AioContext *ctx, NopRequest *nop)
+{
+    struct io_uring_sqe *sqe = aio_uring_get_sqe(ctx);
+
+    *nop = (NopRequest) {
+        .req.cb = nop_cb,
+    };
+    if (!sqe) {
+        return false;
+    }
+    io_uring_prep_nop(sqe);
+    aio_uring_sqe_set_request(sqe, &nop->req);
+    nop->submitted = true;
+    return true;
+}
+
+static void iothread_nop_bh(void *opaque)
+{
+    NopRequest *nop = opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    if (submit_nop(ctx, nop)) {
+        while (!nop->done) {
+            aio_poll(ctx, true);
+        }
+    }
+}
+
+/* The GSource of an IOThread does not turn off fdmon-io_uring */
+static void test_iothread(void)
+{
+    IOThread *iothread;
+    AioContext *ctx;
+    NopRequest nop;
+
+    if (!have_fdmon_io_uring) {
+        g_test_skip("fdmon-io_uring is not available");
+        return;
+    }
+
+    iothread = iothread_new();
+    ctx = iothread_get_aio_context(iothread);
+
+    aio_context_acquire(ctx);
+    aio_wait_bh_oneshot(ctx, iothread_nop_bh, &nop);
+    aio_context_release(ctx);
+
+    g_assert(nop.submitted);
+    g_assert(nop.done);
+
+    iothread_join(iothread);
+}
+
+/* Running the main loop switches to fdmon-poll, which completes requests */
+static void test_g_source_switch(void)
+{
+    AioContext *ctx = qemu_get_aio_context();
+    NopRequest nop;
+
+    if (!have_fdmon_io_uring) {
+        g_test_skip("fdmon-io_uring is not available");
+        return;
+    }
+
+    g_assert(submit_nop(ctx, &nop));
+    g_assert(!nop.done);
+
+    g_main_context_iteration(NULL, false);
+    g_assert(nop.done);
+
+    /* No ring to share anymore */
+    g_assert(!submit_nop(ctx, &nop));
+}
+
+int main(int argc, char **argv)
+{
+    AioContext *ctx;
+    NopRequest nop;
+
+    qemu_init_main_loop(&error_fatal);
+    ctx = qemu_get_aio_context();
+
+    /* The kernel may not support it; this runs no glib iteration */
+    have_fdmon_io_uring = submit_nop(ctx, &nop);
+    while (have_fdmon_io_uring && !nop.done) {
+        aio_poll(ctx, true);
+    }
+
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/fdmon-io_uring/iothread", test_iothread);
+    g_test_add_func("/fdmon-io_uring/g-source-switch", test_g_source_switch);
+    return g_test_run();
+}
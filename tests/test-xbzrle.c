@@ -174,6 +174,67 @@ static void test_encode_decode(void)
     }
 }
 
+#define XBZRLE_ACCEL_PATTERNS 1000
+
+static void test_encode_accel(void)
+{
+    uint8_t *old_buf = g_malloc(XBZRLE_PAGE_SIZE * XBZRLE_ACCEL_PATTERNS);
+    uint8_t *new_buf = g_malloc(XBZRLE_PAGE_SIZE * XBZRLE_ACCEL_PATTERNS);
+    uint8_t *ref = g_malloc(XBZRLE_PAGE_SIZE * XBZRLE_ACCEL_PATTERNS);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int ref_len[XBZRLE_ACCEL_PATTERNS];
+    bool first = true;
+    int i, j;
+
+    /* Random pages with runs of changed bytes of random density */
+    for (i = 0; i < XBZRLE_ACCEL_PATTERNS; i++) {
+        uint8_t *o = old_buf + i * XBZRLE_PAGE_SIZE;
+        uint8_t *n = new_buf + i * XBZRLE_PAGE_SIZE;
+        int density = g_test_rand_int_range(0, 65);
+
+        for (j = 0; j < XBZRLE_PAGE_SIZE; j++) {
+            o[j] = g_test_rand_int();
+            n[j] = o[j];
+            if (g_test_rand_int_range(0, 64) < density) {
+                n[j] = o[j] + g_test_rand_int_range(1, 256);
+            }
+        }
+    }
+
+    /*
+     * Every implementation, down to the portable one, must produce
+     * exactly the same encoding, including the overflow cases.
+     */
+    do {
+        for (i = 0; i < XBZRLE_ACCEL_PATTERNS; i++) {
+            int dlen = i & 1 ? XBZRLE_PAGE_SIZE : i % XBZRLE_PAGE_SIZE;
+            uint8_t *r = ref + i * XBZRLE_PAGE_SIZE;
+            int rc;
+
+            rc = xbzrle_encode_buffer(old_buf + i * XBZRLE_PAGE_SIZE,
+                                      new_buf + i * XBZRLE_PAGE_SIZE,
+                                      XBZRLE_PAGE_SIZE, compressed, dlen);
+            if (first) {
+                ref_len[i] = rc;
+                if (rc > 0) {
+                    memcpy(r, compressed, rc);
+                }
+                continue;
+            }
+            g_assert_cmpint(rc, ==, ref_len[i]);
+            if (rc > 0) {
+                g_assert(memcmp(r, compressed, rc) == 0);
+            }
+        }
+        first = false;
+    } while (test_xbzrle_encode_buffer_next_accel());
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(ref);
+    g_free(compressed);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +247,8 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    /* Must be the last one, it leaves the portable encoder selected */
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
@@ -662,6 +662,9 @@ bool aio_poll(AioContext *ctx, bool blocking)
         progress |= aio_dispatch_ready_handlers(ctx, &ready_list);
     }
 
+    /* Completion callbacks of aio_uring_get_sqe() requests */
+    progress |= fdmon_io_uring_dispatch(ctx);
+
     aio_free_deleted_handlers(ctx);
 
     qemu_lockcnt_dec(&ctx->list_lock);
@@ -698,6 +701,9 @@ void aio_context_use_g_source(AioContext *ctx)
      * support mixed glib/aio_poll() usage. It relies on aio_poll() being
      * called regularly so that changes to the monitored file descriptors are
      * submitted, otherwise a list of pending fd handlers builds up.
+     *
+     * Called each time glib prepares the GSource; after the first time
+     * there is nothing left to do.
      */
     fdmon_io_uring_destroy(ctx);
     aio_free_deleted_handlers(ctx);
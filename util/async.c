@@ -249,6 +249,12 @@ aio_ctx_prepare(GSource *source, gint    *timeout)
 {
     AioContext *ctx = (AioContext *) source;
 
+    /*
+     * Only now that glib runs the context, and not when the GSource is
+     * created: every IOThread has one, but most never run it.
+     */
+    aio_context_use_g_source(ctx);
+
     qatomic_set(&ctx->notify_me, qatomic_read(&ctx->notify_me) | 1);
 
     /*
@@ -362,7 +368,6 @@ static GSourceFuncs aio_source_funcs = {
 
 GSource *aio_get_g_source(AioContext *ctx)
 {
-    aio_context_use_g_source(ctx);
     g_source_ref(&ctx->source);
     return &ctx->source;
 }
@@ -401,7 +406,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(&ctx->linux_io_uring_params, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -417,6 +422,23 @@ LuringState *aio_get_linux_io_uring(AioContext *ctx)
 }
 #endif
 
+void aio_context_set_io_uring_params(AioContext *ctx,
+                                     const AioIoUringParams *params,
+                                     Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (ctx->linux_io_uring) {
+        error_setg(errp, "io_uring is already in use by this AioContext");
+        return;
+    }
+    ctx->linux_io_uring_params = *params;
+#else
+    if (params->sqpoll || params->iopoll) {
+        error_setg(errp, "io_uring is not supported by this build");
+    }
+#endif
+}
+
 void aio_notify(AioContext *ctx)
 {
     /*
@@ -526,6 +548,9 @@ AioContext *aio_context_new(Error **errp)
 
 #ifdef CONFIG_LINUX_IO_URING
     ctx->linux_io_uring = NULL;
+    ctx->linux_io_uring_params = (AioIoUringParams) {
+        .sq_thread_cpu = -1,
+    };
 #endif
 
     ctx->thread_pool = NULL;
@@ -19,9 +19,12 @@
  * 4. Nanosecond timeouts are supported so it requires fewer syscalls than
  *    epoll(7).
  *
- * This code only monitors file descriptors and does not do asynchronous disk
- * I/O.  Implementing disk I/O efficiently has other requirements and should
- * use a separate io_uring so it does not make sense to unify the code.
+ * Other users of the AioContext can add their own requests to the ring with
+ * aio_uring_get_sqe(), e.g. for disk or socket I/O.  They are submitted and
+ * reaped by the same io_uring_enter() calls as the fd monitoring requests,
+ * and their completion callbacks run from aio_poll() like fd handlers.  The
+ * user_data of these requests has FDMON_IO_URING_REQUEST set, which tells
+ * them apart from AioHandlers.
  *
  * File descriptor monitoring is implemented using the following operations:
  *
@@ -38,9 +41,15 @@
  * the "cq ring".  Ring entries are called "sqe" and "cqe", respectively.
  *
  * The code is structured so that sq/cq rings are only modified within
- * fdmon_io_uring_wait().  Changes to AioHandlers are made by enqueuing them on
+ * fdmon_io_uring_wait() and by aio_uring_get_sqe() users, all in the
+ * AioContext's thread.  Changes to AioHandlers are made by enqueuing them on
  * ctx->submit_list so that fdmon_io_uring_wait() can submit IORING_OP_POLL_ADD
  * and/or IORING_OP_POLL_REMOVE sqes for them.
+ *
+ * While external clients are disabled, an external handler whose
+ * IORING_OP_POLL_ADD completes is not re-armed but parked, so that it does
+ * not fire over and over.  It is re-armed once external clients are enabled
+ * again.  Requests from aio_uring_get_sqe() keep completing in the meantime.
  */
 
 #include "qemu/osdep.h"
@@ -55,6 +64,10 @@ enum {
     FDMON_IO_URING_PENDING  = (1 << 0),
     FDMON_IO_URING_ADD      = (1 << 1),
     FDMON_IO_URING_REMOVE   = (1 << 2),
+    FDMON_IO_URING_PARKED   = (1 << 3),
+
+    /* user_data bit of the requests from aio_uring_get_sqe() */
+    FDMON_IO_URING_REQUEST  = 1,
 };
 
 static inline int poll_events_from_pfd(int pfd_events)
@@ -74,8 +87,8 @@ static inline int pfd_events_from_poll(int poll_events)
 }
 
 /*
- * Returns an sqe for submitting a request.  Only be called within
- * fdmon_io_uring_wait().
+ * Returns an sqe for submitting a request.  Only be called from the
+ * AioContext's thread.
  */
 static struct io_uring_sqe *get_sqe(AioContext *ctx)
 {
@@ -209,18 +222,39 @@ static void fill_sq_ring(AioContext *ctx)
         if (flags & FDMON_IO_URING_ADD) {
             add_poll_add_sqe(ctx, node);
         }
-        if (flags & FDMON_IO_URING_REMOVE) {
+        if ((flags & FDMON_IO_URING_REMOVE) &&
+            (flags & FDMON_IO_URING_PARKED)) {
+            /* There is no IORING_OP_POLL_ADD to wait for */
+            QLIST_REMOVE(node, node_parked);
+            qatomic_and(&node->flags, ~(FDMON_IO_URING_PARKED |
+                                        FDMON_IO_URING_REMOVE));
+            QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                  node_deleted);
+        } else if (flags & FDMON_IO_URING_REMOVE) {
             add_poll_remove_sqe(ctx, node);
         }
     }
 }
 
+/* Re-arm the handlers parked while external clients were disabled */
+static void unpark_handlers(AioContext *ctx)
+{
+    AioHandler *node;
+
+    while ((node = QLIST_FIRST(&ctx->fdmon_io_uring_parked))) {
+        QLIST_REMOVE(node, node_parked);
+        qatomic_and(&node->flags, ~FDMON_IO_URING_PARKED);
+        add_poll_add_sqe(ctx, node);
+    }
+}
+
 /* Returns true if a handler became ready */
 static bool process_cqe(AioContext *ctx,
                         AioHandlerList *ready_list,
                         struct io_uring_cqe *cqe)
 {
-    AioHandler *node = io_uring_cqe_get_data(cqe);
+    uintptr_t data = (uintptr_t)io_uring_cqe_get_data(cqe);
+    AioHandler *node = (AioHandler *)data;
     unsigned flags;
 
     /* poll_timeout and poll_remove have a zero user_data field */
@@ -228,6 +262,16 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+    /* The callback runs from fdmon_io_uring_dispatch() */
+    if (data & FDMON_IO_URING_REQUEST) {
+        AioUringRequest *req = (void *)(data & ~FDMON_IO_URING_REQUEST);
+
+        req->res = cqe->res;
+        QSIMPLEQ_INSERT_TAIL(&ctx->uring_completed, req, next);
+        ctx->uring_requests--;
+        return false;
+    }
+
     /*
      * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
      * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
@@ -239,6 +283,12 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+    if (node->is_external && qatomic_read(&ctx->external_disable_cnt)) {
+        qatomic_or(&node->flags, FDMON_IO_URING_PARKED);
+        QLIST_INSERT_HEAD(&ctx->fdmon_io_uring_parked, node, node_parked);
+        return false;
+    }
+
     aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
 
     /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
@@ -272,9 +322,8 @@ static int fdmon_io_uring_wait(AioContext *ctx, AioHandlerList *ready_list,
     unsigned wait_nr = 1; /* block until at least one cqe is ready */
     int ret;
 
-    /* Fall back while external clients are disabled */
-    if (qatomic_read(&ctx->external_disable_cnt)) {
-        return fdmon_poll_ops.wait(ctx, ready_list, timeout);
+    if (!qatomic_read(&ctx->external_disable_cnt)) {
+        unpark_handlers(ctx);
     }
 
     if (timeout == 0) {
@@ -311,8 +360,41 @@ static bool fdmon_io_uring_need_wait(AioContext *ctx)
         return true;
     }
 
-    /* Are we falling back to fdmon-poll? */
-    return qatomic_read(&ctx->external_disable_cnt);
+    /* Do parked AioHandlers need to be re-armed? */
+    return !QLIST_EMPTY(&ctx->fdmon_io_uring_parked) &&
+           !qatomic_read(&ctx->external_disable_cnt);
+}
+
+struct io_uring_sqe *aio_uring_get_sqe(AioContext *ctx)
+{
+    if (ctx->fdmon_ops != &fdmon_io_uring_ops ||
+        ctx != qemu_get_current_aio_context()) {
+        return NULL;
+    }
+    return get_sqe(ctx);
+}
+
+void aio_uring_sqe_set_request(struct io_uring_sqe *sqe, AioUringRequest *req)
+{
+    uintptr_t data = (uintptr_t)req;
+
+    assert(!(data & FDMON_IO_URING_REQUEST));
+    io_uring_sqe_set_data(sqe, (void *)(data | FDMON_IO_URING_REQUEST));
+    qemu_get_current_aio_context()->uring_requests++;
+}
+
+bool fdmon_io_uring_dispatch(AioContext *ctx)
+{
+    AioUringRequest *req;
+    bool progress = false;
+
+    /* Callbacks can run a nested aio_poll(), so dequeue first */
+    while ((req = QSIMPLEQ_FIRST(&ctx->uring_completed))) {
+        QSIMPLEQ_REMOVE_HEAD(&ctx->uring_completed, next);
+        req->cb(req);
+        progress = true;
+    }
+    return progress;
 }
 
 static const FDMonOps fdmon_io_uring_ops = {
@@ -331,6 +413,9 @@ bool fdmon_io_uring_setup(AioContext *ctx)
     }
 
     QSLIST_INIT(&ctx->submit_list);
+    QLIST_INIT(&ctx->fdmon_io_uring_parked);
+    QSIMPLEQ_INIT(&ctx->uring_completed);
+    ctx->uring_requests = 0;
     ctx->fdmon_ops = &fdmon_io_uring_ops;
     return true;
 }
@@ -338,7 +423,22 @@ bool fdmon_io_uring_setup(AioContext *ctx)
 void fdmon_io_uring_destroy(AioContext *ctx)
 {
     if (ctx->fdmon_ops == &fdmon_io_uring_ops) {
+        AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
         AioHandler *node;
+        int ret;
+
+        /*
+         * The requests from aio_uring_get_sqe() cannot move to another
+         * ring, wait for them.  Ready handlers are dropped, fdmon-poll
+         * reports them again.
+         */
+        while (ctx->uring_requests) {
+            do {
+                ret = io_uring_submit_and_wait(&ctx->fdmon_io_uring, 1);
+            } while (ret == -EINTR);
+            assert(ret >= 0);
+            process_cq_ring(ctx, &ready_list);
+        }
 
         io_uring_queue_exit(&ctx->fdmon_io_uring);
 
@@ -356,6 +456,15 @@ void fdmon_io_uring_destroy(AioContext *ctx)
             QSLIST_REMOVE_HEAD_RCU(&ctx->submit_list, node_submitted);
         }
 
+        /* Parked handlers are monitored by fdmon-poll from now on */
+        while ((node = QLIST_FIRST(&ctx->fdmon_io_uring_parked))) {
+            QLIST_REMOVE(node, node_parked);
+            qatomic_and(&node->flags, ~FDMON_IO_URING_PARKED);
+        }
+
         ctx->fdmon_ops = &fdmon_poll_ops;
+
+        /* New requests from the callbacks go elsewhere now */
+        fdmon_io_uring_dispatch(ctx);
     }
 }